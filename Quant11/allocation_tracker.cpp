@@ -0,0 +1,74 @@
+#include "allocation_tracker.h"
+
+#if defined(QUANT_TRACK_ALLOCATIONS)
+#include <cstdlib>
+#include <new>
+
+namespace {
+// Constant-initialised so touching it never allocates
+thread_local AllocationCounters t_allocations{0, 0};
+
+void* counted_malloc(std::size_t size) noexcept {
+    ++t_allocations.count;
+    t_allocations.bytes += size;
+    return std::malloc(size ? size : 1);
+}
+
+void* counted_new(std::size_t size) {
+    for (;;) {
+        if (void* p = counted_malloc(size)) {
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+}
+
+AllocationCounters AllocationTracker::thread_counters() {
+    return t_allocations;
+}
+
+void* operator new(std::size_t size) {
+    return counted_new(size);
+}
+
+void* operator new[](std::size_t size) {
+    return counted_new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+
+// Heap allocations made by a thread
+struct AllocationCounters {
+    uint64_t count;
+    uint64_t bytes;
+};
+
+inline AllocationCounters operator-(const AllocationCounters& end, const AllocationCounters& start) {
+    return AllocationCounters{end.count - start.count, end.bytes - start.bytes};
+}
+
+// Opt-in allocation profiler. Building with QUANT_TRACK_ALLOCATIONS replaces
+// the global operator new/delete with versions that count every allocation in
+// thread-local counters; spans read the counters at start and end and report
+// the difference to their metric. Without the flag nothing is hooked and the
+// counters read as zero.
+class AllocationTracker {
+public:
+#if defined(QUANT_TRACK_ALLOCATIONS)
+    static constexpr bool enabled = true;
+    static AllocationCounters thread_counters();
+#else
+    static constexpr bool enabled = false;
+    static AllocationCounters thread_counters() { return AllocationCounters{0, 0}; }
+#endif
+};
+
+// Allocations attributed to one metric's spans. Spans include the
+// allocations of any spans nested inside them.
+struct AllocationTotals {
+    uint64_t spans = 0;
+    uint64_t allocating_spans = 0;
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t max_allocations = 0;
+
+    void merge(const AllocationTotals& other) {
+        spans += other.spans;
+        allocating_spans += other.allocating_spans;
+        allocations += other.allocations;
+        bytes += other.bytes;
+        if (other.max_allocations > max_allocations) {
+            max_allocations = other.max_allocations;
+        }
+    }
+};
+
+// AllocationTotals updated by one thread and readable from any other
+class AllocationStats {
+public:
+    // Owning thread only
+    void add(const AllocationCounters& span) {
+        bump(m_spans, 1);
+        if (span.count > 0) {
+            bump(m_allocating_spans, 1);
+            bump(m_allocations, span.count);
+            bump(m_bytes, span.bytes);
+            if (span.count > m_max_allocations.load(std::memory_order_relaxed)) {
+                m_max_allocations.store(span.count, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    AllocationTotals load() const {
+        AllocationTotals totals;
+        totals.spans = m_spans.load(std::memory_order_relaxed);
+        totals.allocating_spans = m_allocating_spans.load(std::memory_order_relaxed);
+        totals.allocations = m_allocations.load(std::memory_order_relaxed);
+        totals.bytes = m_bytes.load(std::memory_order_relaxed);
+        totals.max_allocations = m_max_allocations.load(std::memory_order_relaxed);
+        return totals;
+    }
+
+    // Racy against the owner by design: an update in flight may survive
+    void reset() {
+        for (std::atomic<uint64_t>* field : {&m_spans, &m_allocating_spans, &m_allocations, &m_bytes, &m_max_allocations}) {
+            field->store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static void bump(std::atomic<uint64_t>& field, uint64_t delta) {
+        field.store(field.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> m_spans{0};
+    std::atomic<uint64_t> m_allocating_spans{0};
+    std::atomic<uint64_t> m_allocations{0};
+    std::atomic<uint64_t> m_bytes{0};
+    std::atomic<uint64_t> m_max_allocations{0};
+};
@@ -39,6 +39,7 @@ std::string ApiManager::GetFormattedTimestamp() {
 }
 
 std::string ApiManager::SendRequest(const std::string& endpoint, const std::string& method, const std::string& data) {
+    ApiManagerInstrumentation::Span span(m_instrumentation, BuiltinMetric::ApiRequest);
     CURL* curl = curl_easy_init();
     if (!curl) {
         return "Error initializing CURL";
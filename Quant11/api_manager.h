@@ -3,14 +3,17 @@
 #include <memory>
 #include "api_credentials.h"
 #include "token_manager.h"
+#include "instrumentation.h"
 
 class ApiManager {
 private:
     std::unique_ptr<ApiCredentials> m_credentials;
     std::unique_ptr<TokenManager> m_token_manager;
     std::string m_base_url;
+    ApiManagerInstrumentation m_instrumentation;
 
 public:
+    void set_performance_monitor(PerformanceMonitor& monitor) { m_instrumentation.attach(monitor); }
     ApiManager();
     std::string place_order(const std::string& symbol, const std::string& side, 
                           double price, double amount);
@@ -0,0 +1,137 @@
+#include "event_loop_monitor.h"
+#include <algorithm>
+#include <mutex>
+
+struct EventLoopMonitor::State {
+    State(PerformanceMonitor& performance_monitor, boost::asio::io_service& service, const std::string& name,
+          std::chrono::microseconds probe_interval)
+        : monitor(performance_monitor),
+          io_service(service),
+          timer(service),
+          interval(probe_interval),
+          timer_lag(performance_monitor.register_metric(name + ".timer_lag")),
+          post_delay(performance_monitor.register_metric(name + ".post_delay")) {}
+
+    // Guards monitor use against stop()
+    std::mutex mutex;
+    bool running = false;
+    // A probe chain is scheduled on the loop; it ends at the first probe after stop()
+    bool armed = false;
+    PerformanceMonitor& monitor;
+    boost::asio::io_service& io_service;
+    boost::asio::steady_timer timer;
+    std::chrono::microseconds interval;
+    std::chrono::steady_clock::time_point deadline;
+    MetricHandle timer_lag;
+    MetricHandle post_delay;
+};
+
+EventLoopMonitor::EventLoopMonitor(PerformanceMonitor& monitor, boost::asio::io_service& io_service,
+                                   const std::string& name, std::chrono::microseconds interval)
+    : m_state(std::make_shared<State>(monitor, io_service, name, interval)) {}
+
+EventLoopMonitor::~EventLoopMonitor() {
+    stop();
+}
+
+void EventLoopMonitor::start() {
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if (m_state->running) {
+            return;
+        }
+        m_state->running = true;
+        if (m_state->armed) {
+            return;  // Restarted before the previous chain ended; it carries on
+        }
+        m_state->armed = true;
+        m_state->deadline = std::chrono::steady_clock::now();
+    }
+    // The timer is only touched from the loop's thread
+    std::shared_ptr<State> state = m_state;
+    m_state->io_service.post([state] { arm(state); });
+}
+
+void EventLoopMonitor::stop() {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->running = false;
+}
+
+void EventLoopMonitor::arm(const std::shared_ptr<State>& state) {
+    // Probes keep a fixed cadence; after a long stall, skip the missed ones
+    const auto now = std::chrono::steady_clock::now();
+    state->deadline = std::max(state->deadline + state->interval, now);
+    state->timer.expires_at(state->deadline);
+    state->timer.async_wait([state](const boost::system::error_code& ec) {
+        if (ec) {
+            return;
+        }
+        const auto fired = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->running) {
+                state->armed = false;
+                return;
+            }
+            state->monitor.record_latency_ns(state->timer_lag, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(fired - state->deadline).count()));
+        }
+
+        const uint64_t posted_ns = PerformanceMonitor::now_ns();
+        state->io_service.post([state, posted_ns] {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->running) {
+                state->monitor.record_latency_ns(state->post_delay, PerformanceMonitor::now_ns() - posted_ns);
+            }
+        });
+        arm(state);
+    });
+}
+
+JitterMonitor::JitterMonitor(PerformanceMonitor& monitor, const std::string& name, Mode mode,
+                             std::chrono::microseconds resolution)
+    : m_monitor(monitor), m_metric(monitor.register_metric(name)), m_name(name), m_mode(mode),
+      m_resolution(resolution) {}
+
+JitterMonitor::~JitterMonitor() {
+    stop();
+}
+
+void JitterMonitor::start() {
+    if (m_running.exchange(true)) {
+        return;
+    }
+    m_thread = std::thread(&JitterMonitor::run, this);
+}
+
+void JitterMonitor::stop() {
+    m_running.store(false);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void JitterMonitor::run() {
+    m_monitor.set_thread_name(m_name);
+    const uint64_t resolution_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(m_resolution).count());
+
+    while (m_running.load(std::memory_order_relaxed)) {
+        if (m_mode == Mode::Spin) {
+            uint64_t last = PerformanceMonitor::now_ns();
+            const uint64_t window_end = last + resolution_ns;
+            uint64_t largest_gap = 0;
+            while (last < window_end) {
+                const uint64_t now = PerformanceMonitor::now_ns();
+                largest_gap = std::max(largest_gap, now - last);
+                last = now;
+            }
+            m_monitor.record_latency_ns(m_metric, largest_gap);
+        } else {
+            const uint64_t before = PerformanceMonitor::now_ns();
+            std::this_thread::sleep_for(m_resolution);
+            const uint64_t slept = PerformanceMonitor::now_ns() - before;
+            m_monitor.record_latency_ns(m_metric, slept > resolution_ns ? slept - resolution_ns : 0);
+        }
+    }
+}
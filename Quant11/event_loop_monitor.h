@@ -0,0 +1,71 @@
+#pragma once
+
+#include "performance_monitor.h"
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Watchdog for an asio event loop. Every interval a probe timer fires on the
+// loop and records how late it ran (<name>.timer_lag), then posts a task and
+// records how long it waited in the queue (<name>.post_delay). Both grow when
+// a handler blocks the loop.
+class EventLoopMonitor {
+public:
+    EventLoopMonitor(PerformanceMonitor& monitor, boost::asio::io_service& io_service, const std::string& name,
+                     std::chrono::microseconds interval = std::chrono::milliseconds(1));
+    ~EventLoopMonitor();
+
+    EventLoopMonitor(const EventLoopMonitor&) = delete;
+    EventLoopMonitor& operator=(const EventLoopMonitor&) = delete;
+
+    // Probes run once the io_service is running; safe to call before run()
+    void start();
+    // After stop returns no probe touches the PerformanceMonitor again
+    void stop();
+
+private:
+    // Shared with in-flight handlers, which may outlive the monitor
+    struct State;
+
+    static void arm(const std::shared_ptr<State>& state);
+
+    std::shared_ptr<State> m_state;
+};
+
+// Measures OS scheduling hiccups on a dedicated thread. In Spin mode the
+// thread reads the clock in a tight loop and records the largest gap seen in
+// each resolution window; in Sleep mode it records how far each sleep of one
+// resolution overran. Recorded as <name> in the monitor.
+class JitterMonitor {
+public:
+    enum class Mode {
+        Spin,
+        Sleep
+    };
+
+    explicit JitterMonitor(PerformanceMonitor& monitor, const std::string& name = "scheduler.hiccup",
+                           Mode mode = Mode::Spin,
+                           std::chrono::microseconds resolution = std::chrono::milliseconds(1));
+    ~JitterMonitor();
+
+    JitterMonitor(const JitterMonitor&) = delete;
+    JitterMonitor& operator=(const JitterMonitor&) = delete;
+
+    void start();
+    void stop();
+
+private:
+    void run();
+
+    PerformanceMonitor& m_monitor;
+    MetricHandle m_metric;
+    std::string m_name;
+    Mode m_mode;
+    std::chrono::microseconds m_resolution;
+    std::atomic<bool> m_running{false};
+    std::thread m_thread;
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "performance_monitor.h"
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+// Compile-time instrumentation policies. Each component times its hot paths
+// through the policy chosen for it at build time, so a production binary can
+// keep full monitoring on one component, sample another and compile a third
+// down to nothing.
+//
+// Select a level for everything with QUANT_INSTRUMENTATION, or per component
+// with QUANT_<COMPONENT>_INSTRUMENTATION, set to QUANT_INSTRUMENTATION_FULL,
+// QUANT_INSTRUMENTATION_SAMPLED or QUANT_INSTRUMENTATION_NONE.
+#define QUANT_INSTRUMENTATION_NONE 0
+#define QUANT_INSTRUMENTATION_SAMPLED 1
+#define QUANT_INSTRUMENTATION_FULL 2
+
+#ifndef QUANT_INSTRUMENTATION
+#define QUANT_INSTRUMENTATION QUANT_INSTRUMENTATION_FULL
+#endif
+// One span in this many is recorded at the sampled level
+#ifndef QUANT_INSTRUMENTATION_SAMPLE_RATE
+#define QUANT_INSTRUMENTATION_SAMPLE_RATE 64
+#endif
+
+#ifndef QUANT_WEBSOCKET_SERVER_INSTRUMENTATION
+#define QUANT_WEBSOCKET_SERVER_INSTRUMENTATION QUANT_INSTRUMENTATION
+#endif
+#ifndef QUANT_ORDER_MANAGER_INSTRUMENTATION
+#define QUANT_ORDER_MANAGER_INSTRUMENTATION QUANT_INSTRUMENTATION
+#endif
+#ifndef QUANT_API_MANAGER_INSTRUMENTATION
+#define QUANT_API_MANAGER_INSTRUMENTATION QUANT_INSTRUMENTATION
+#endif
+
+// A ScopedSpan that only runs when given a monitor. Built in place, so a
+// span that is not recorded neither reads the clock nor allocates.
+class OptionalScopedSpan {
+public:
+    OptionalScopedSpan(PerformanceMonitor* monitor, MetricHandle metric) : m_active(monitor != nullptr) {
+        if (m_active) {
+            new (&m_storage) ScopedSpan(*monitor, metric);
+        }
+    }
+    ~OptionalScopedSpan() {
+        if (m_active) {
+            span().~ScopedSpan();
+        }
+    }
+
+    OptionalScopedSpan(const OptionalScopedSpan&) = delete;
+    OptionalScopedSpan& operator=(const OptionalScopedSpan&) = delete;
+
+    // Kept with the sample if it is an outlier
+    void set_context(const SampleContext& context) {
+        if (m_active) {
+            span().set_context(context);
+        }
+    }
+
+private:
+    ScopedSpan& span() { return *reinterpret_cast<ScopedSpan*>(&m_storage); }
+
+    std::aligned_storage<sizeof(ScopedSpan), alignof(ScopedSpan)>::type m_storage;
+    bool m_active;
+};
+
+// Span finished explicitly, possibly on another thread. Copyable so it can
+// travel with a completion callback; allocations are not attributed, and
+// nothing is recorded without a monitor.
+class OptionalAsyncSpan {
+public:
+    OptionalAsyncSpan(PerformanceMonitor* monitor, MetricHandle metric)
+        : m_monitor(monitor), m_metric(metric), m_start_ns(monitor ? PerformanceMonitor::now_ns() : 0) {}
+
+    void finish() const {
+        if (m_monitor) {
+            m_monitor->record_span(m_metric, m_start_ns, PerformanceMonitor::now_ns());
+        }
+    }
+
+private:
+    PerformanceMonitor* m_monitor;
+    MetricHandle m_metric;
+    uint64_t m_start_ns;
+};
+
+// Records every span. The monitor is optional so components can be built
+// before one is attached.
+class FullInstrumentation {
+public:
+    explicit FullInstrumentation(PerformanceMonitor* monitor = nullptr) : m_monitor(monitor) {}
+
+    void attach(PerformanceMonitor& monitor) { m_monitor = &monitor; }
+    PerformanceMonitor* monitor() const { return m_monitor; }
+
+    void set_thread_name(const std::string& name) const {
+        if (m_monitor) {
+            m_monitor->set_thread_name(name);
+        }
+    }
+
+    class Span : public OptionalScopedSpan {
+    public:
+        Span(const FullInstrumentation& instrumentation, MetricHandle metric)
+            : OptionalScopedSpan(instrumentation.m_monitor, metric) {}
+        Span(const FullInstrumentation& instrumentation, BuiltinMetric metric)
+            : Span(instrumentation, PerformanceMonitor::builtin_handle(metric)) {}
+    };
+
+    // Times an operation that completes on another thread, such as a request
+    // acknowledged on an event loop
+    class AsyncSpan : public OptionalAsyncSpan {
+    public:
+        AsyncSpan(const FullInstrumentation& instrumentation, MetricHandle metric)
+            : OptionalAsyncSpan(instrumentation.m_monitor, metric) {}
+        AsyncSpan(const FullInstrumentation& instrumentation, BuiltinMetric metric)
+            : AsyncSpan(instrumentation, PerformanceMonitor::builtin_handle(metric)) {}
+    };
+
+private:
+    PerformanceMonitor* m_monitor;
+};
+
+// Records one span in every Rate of each metric on each thread, so the
+// recorded latency distribution is representative at a fraction of the cost.
+// Counts and rates reported for these metrics are 1/Rate of the real figures.
+template <uint32_t Rate>
+class SampledInstrumentation {
+    static_assert(Rate > 0, "sample rate must be positive");
+
+public:
+    explicit SampledInstrumentation(PerformanceMonitor* monitor = nullptr) : m_monitor(monitor) {}
+
+    void attach(PerformanceMonitor& monitor) { m_monitor = &monitor; }
+    PerformanceMonitor* monitor() const { return m_monitor; }
+
+    void set_thread_name(const std::string& name) const {
+        if (m_monitor) {
+            m_monitor->set_thread_name(name);
+        }
+    }
+
+    class Span : public OptionalScopedSpan {
+    public:
+        Span(const SampledInstrumentation& instrumentation, MetricHandle metric)
+            : OptionalScopedSpan(instrumentation.m_monitor && sample(metric) ? instrumentation.m_monitor : nullptr,
+                                 metric) {}
+        Span(const SampledInstrumentation& instrumentation, BuiltinMetric metric)
+            : Span(instrumentation, PerformanceMonitor::builtin_handle(metric)) {}
+    };
+
+    class AsyncSpan : public OptionalAsyncSpan {
+    public:
+        AsyncSpan(const SampledInstrumentation& instrumentation, MetricHandle metric)
+            : OptionalAsyncSpan(instrumentation.m_monitor && sample(metric) ? instrumentation.m_monitor : nullptr,
+                                metric) {}
+        AsyncSpan(const SampledInstrumentation& instrumentation, BuiltinMetric metric)
+            : AsyncSpan(instrumentation, PerformanceMonitor::builtin_handle(metric)) {}
+    };
+
+private:
+    // Counted per metric, so nested spans of different metrics do not fall
+    // into lockstep and leave one of them never sampled. Metrics registered
+    // past SAMPLE_COUNTERS share counters.
+    static const size_t SAMPLE_COUNTERS = 64;
+
+    static bool sample(MetricHandle metric) {
+        thread_local uint32_t counters[SAMPLE_COUNTERS] = {};
+        uint32_t& counter = counters[metric.index % SAMPLE_COUNTERS];
+        if (++counter < Rate) {
+            return false;
+        }
+        counter = 0;
+        return true;
+    }
+
+    PerformanceMonitor* m_monitor;
+};
+
+// Compiles to nothing: spans are empty and never read the clock
+class NoInstrumentation {
+public:
+    explicit NoInstrumentation(PerformanceMonitor* = nullptr) {}
+
+    void attach(PerformanceMonitor&) {}
+    PerformanceMonitor* monitor() const { return nullptr; }
+    void set_thread_name(const std::string&) const {}
+
+    class Span {
+    public:
+        Span(const NoInstrumentation&, MetricHandle) {}
+        Span(const NoInstrumentation&, BuiltinMetric) {}
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        void set_context(const SampleContext&) {}
+    };
+
+    class AsyncSpan {
+    public:
+        AsyncSpan(const NoInstrumentation&, MetricHandle) {}
+        AsyncSpan(const NoInstrumentation&, BuiltinMetric) {}
+
+        void finish() const {}
+    };
+};
+
+template <int Level>
+struct InstrumentationPolicy;
+
+template <>
+struct InstrumentationPolicy<QUANT_INSTRUMENTATION_NONE> {
+    using type = NoInstrumentation;
+};
+
+template <>
+struct InstrumentationPolicy<QUANT_INSTRUMENTATION_SAMPLED> {
+    using type = SampledInstrumentation<QUANT_INSTRUMENTATION_SAMPLE_RATE>;
+};
+
+template <>
+struct InstrumentationPolicy<QUANT_INSTRUMENTATION_FULL> {
+    using type = FullInstrumentation;
+};
+
+using WebSocketServerInstrumentation = InstrumentationPolicy<QUANT_WEBSOCKET_SERVER_INSTRUMENTATION>::type;
+using OrderManagerInstrumentation = InstrumentationPolicy<QUANT_ORDER_MANAGER_INSTRUMENTATION>::type;
+using ApiManagerInstrumentation = InstrumentationPolicy<QUANT_API_MANAGER_INSTRUMENTATION>::type;
@@ -0,0 +1,157 @@
+#include "latency_histogram.h"
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram(uint64_t highest_trackable_value, int significant_digits)
+    : m_highest_trackable_value(std::max<uint64_t>(highest_trackable_value, 2)),
+      m_significant_digits(std::min(std::max(significant_digits, 1), 5)) {
+    // Smallest power of two sub-bucket count that resolves 2 * 10^digits values
+    const uint64_t largest_single_unit_resolution = 2 * static_cast<uint64_t>(std::pow(10, m_significant_digits));
+    int sub_bucket_count_magnitude = static_cast<int>(std::ceil(std::log2(static_cast<double>(largest_single_unit_resolution))));
+    m_sub_bucket_half_count_magnitude = std::max(sub_bucket_count_magnitude, 1) - 1;
+    const int sub_bucket_count = 1 << (m_sub_bucket_half_count_magnitude + 1);
+    m_sub_bucket_half_count = sub_bucket_count / 2;
+    m_sub_bucket_mask = static_cast<uint64_t>(sub_bucket_count) - 1;
+
+    // Buckets needed until the top bucket covers the highest trackable value
+    uint64_t smallest_untrackable_value = static_cast<uint64_t>(sub_bucket_count);
+    m_bucket_count = 1;
+    while (smallest_untrackable_value <= m_highest_trackable_value) {
+        if (smallest_untrackable_value > std::numeric_limits<uint64_t>::max() / 2) {
+            ++m_bucket_count;
+            break;
+        }
+        smallest_untrackable_value <<= 1;
+        ++m_bucket_count;
+    }
+    m_counts.assign(static_cast<size_t>(m_bucket_count + 1) * m_sub_bucket_half_count, 0);
+}
+
+bool LatencyHistogram::merge(const LatencyHistogram& other) {
+    if (other.m_counts.size() != m_counts.size() ||
+        other.m_sub_bucket_half_count_magnitude != m_sub_bucket_half_count_magnitude) {
+        return false;
+    }
+    for (size_t i = 0; i < m_counts.size(); ++i) {
+        m_counts[i] += other.m_counts[i];
+    }
+    m_total_count += other.m_total_count;
+    m_total_sum += other.m_total_sum;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+    return true;
+}
+
+void LatencyHistogram::reset() {
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    m_total_count = 0;
+    m_total_sum = 0;
+    m_min = std::numeric_limits<uint64_t>::max();
+    m_max = 0;
+}
+
+uint64_t LatencyHistogram::value_from_index(size_t index) const {
+    int bucket_index = static_cast<int>(index >> m_sub_bucket_half_count_magnitude) - 1;
+    int sub_bucket_index = static_cast<int>(index & (m_sub_bucket_half_count - 1)) + m_sub_bucket_half_count;
+    if (bucket_index < 0) {
+        sub_bucket_index -= m_sub_bucket_half_count;
+        bucket_index = 0;
+    }
+    return static_cast<uint64_t>(sub_bucket_index) << bucket_index;
+}
+
+uint64_t LatencyHistogram::highest_equivalent_value(size_t index) const {
+    const int bucket_index = std::max(static_cast<int>(index >> m_sub_bucket_half_count_magnitude) - 1, 0);
+    return value_from_index(index) + (static_cast<uint64_t>(1) << bucket_index) - 1;
+}
+
+uint64_t LatencyHistogram::value_at_percentile(double percentile) const {
+    if (m_total_count == 0) {
+        return 0;
+    }
+    percentile = std::min(std::max(percentile, 0.0), 100.0);
+    uint64_t target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * m_total_count));
+    target = std::max<uint64_t>(target, 1);
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < m_counts.size(); ++i) {
+        cumulative += m_counts[i];
+        if (cumulative >= target) {
+            return std::min(std::max(highest_equivalent_value(i), min()), m_max);
+        }
+    }
+    return m_max;
+}
+
+uint64_t LatencyHistogram::count_at_or_below(uint64_t value) const {
+    if (value >= m_highest_trackable_value) {
+        return m_total_count;
+    }
+    const size_t last = counts_index(value);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= last; ++i) {
+        cumulative += m_counts[i];
+    }
+    return cumulative;
+}
+
+std::vector<uint64_t> LatencyHistogram::values_at_percentiles(const std::vector<double>& percentiles) const {
+    std::vector<uint64_t> values(percentiles.size(), 0);
+    if (m_total_count == 0) {
+        return values;
+    }
+    size_t next = 0;
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < m_counts.size() && next < percentiles.size(); ++i) {
+        cumulative += m_counts[i];
+        while (next < percentiles.size()) {
+            const double percentile = std::min(std::max(percentiles[next], 0.0), 100.0);
+            const uint64_t target = std::max<uint64_t>(
+                static_cast<uint64_t>(std::ceil(percentile / 100.0 * m_total_count)), 1);
+            if (cumulative < target) {
+                break;
+            }
+            values[next++] = std::min(std::max(highest_equivalent_value(i), min()), m_max);
+        }
+    }
+    for (; next < percentiles.size(); ++next) {
+        values[next] = m_max;
+    }
+    return values;
+}
+
+std::vector<uint64_t> LatencyHistogram::counts_at_or_below(const std::vector<uint64_t>& values) const {
+    std::vector<uint64_t> counts(values.size(), m_total_count);
+    size_t next = 0;
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < m_counts.size() && next < values.size(); ++i) {
+        // Index i holds every value up to its highest equivalent value
+        while (next < values.size() && values[next] < m_highest_trackable_value &&
+               counts_index(values[next]) < i) {
+            counts[next++] = cumulative;
+        }
+        cumulative += m_counts[i];
+    }
+    return counts;
+}
+
+double LatencyHistogram::mean() const {
+    return m_total_count ? static_cast<double>(m_total_sum) / m_total_count : 0.0;
+}
+
+double LatencyHistogram::standard_deviation() const {
+    if (m_total_count == 0) {
+        return 0.0;
+    }
+    const double average = mean();
+    double sum_squares = 0.0;
+    for (size_t i = 0; i < m_counts.size(); ++i) {
+        if (m_counts[i] == 0) {
+            continue;
+        }
+        // Midpoint of the bucket's equivalent range
+        const double value = (value_from_index(i) + highest_equivalent_value(i)) / 2.0;
+        const double diff = value - average;
+        sum_squares += diff * diff * m_counts[i];
+    }
+    return std::sqrt(sum_squares / m_total_count);
+}
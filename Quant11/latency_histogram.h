@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+// Fixed-memory log-linear histogram in the style of HdrHistogram.
+//
+// Values are grouped into power-of-two buckets, each split into linear
+// sub-buckets sized so that any recorded value is reported within
+// 10^-significant_digits of its true value. Memory depends only on the
+// configured range and precision, recording is a couple of shifts and an
+// increment, and percentile queries walk the fixed counts array once.
+class LatencyHistogram {
+public:
+    // Tracks values in [0, highest_trackable_value] with 1-5 significant digits.
+    // Larger values are clamped to highest_trackable_value.
+    explicit LatencyHistogram(uint64_t highest_trackable_value = 3600ULL * 1000 * 1000,
+                              int significant_digits = 3);
+
+    void record(uint64_t value, uint64_t count = 1) {
+        if (value > m_highest_trackable_value) {
+            value = m_highest_trackable_value;
+        }
+        m_counts[counts_index(value)] += count;
+        m_total_count += count;
+        m_total_sum += value * count;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    // Adds another histogram's counts. Both must share range and precision.
+    bool merge(const LatencyHistogram& other);
+    void reset();
+
+    // percentile in [0, 100]
+    uint64_t value_at_percentile(double percentile) const;
+    // Number of recorded values that are <= value (at histogram precision)
+    uint64_t count_at_or_below(uint64_t value) const;
+    // Batch forms of the two queries above in a single walk of the counts;
+    // percentiles and values must be ascending
+    std::vector<uint64_t> values_at_percentiles(const std::vector<double>& percentiles) const;
+    std::vector<uint64_t> counts_at_or_below(const std::vector<uint64_t>& values) const;
+    double mean() const;
+    double standard_deviation() const;
+
+    uint64_t total_count() const { return m_total_count; }
+    uint64_t total_sum() const { return m_total_sum; }
+    uint64_t min() const { return m_total_count ? m_min : 0; }
+    uint64_t max() const { return m_max; }
+    uint64_t highest_trackable_value() const { return m_highest_trackable_value; }
+    int significant_digits() const { return m_significant_digits; }
+    size_t memory_size() const { return m_counts.size() * sizeof(uint64_t); }
+
+private:
+    static int leading_zeros(uint64_t value) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        return _BitScanReverse64(&index, value) ? 63 - static_cast<int>(index) : 64;
+#else
+        return __builtin_clzll(value);
+#endif
+    }
+
+    size_t counts_index(uint64_t value) const {
+        const int bucket_index = 64 - leading_zeros(value | m_sub_bucket_mask) - (m_sub_bucket_half_count_magnitude + 1);
+        const int sub_bucket_index = static_cast<int>(value >> bucket_index);
+        const int bucket_base_index = (bucket_index + 1) << m_sub_bucket_half_count_magnitude;
+        return static_cast<size_t>(bucket_base_index + sub_bucket_index - m_sub_bucket_half_count);
+    }
+
+    uint64_t value_from_index(size_t index) const;
+    uint64_t highest_equivalent_value(size_t index) const;
+
+    uint64_t m_highest_trackable_value;
+    int m_significant_digits;
+    int m_sub_bucket_half_count_magnitude;
+    int m_sub_bucket_half_count;
+    uint64_t m_sub_bucket_mask;
+    int m_bucket_count;
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total_count = 0;
+    uint64_t m_total_sum = 0;
+    uint64_t m_min = std::numeric_limits<uint64_t>::max();
+    uint64_t m_max = 0;
+};
@@ -0,0 +1,142 @@
+#include "metrics_exporter.h"
+#include <cstdio>
+#include <iostream>
+
+namespace {
+// Pending lines beyond this are dropped rather than buffered without bound
+const size_t MAX_PENDING_BYTES = 16 * 1024 * 1024;
+}
+
+MetricsExporter::MetricsExporter(const PerformanceMonitor& monitor, const std::string& path,
+                                 std::chrono::milliseconds interval, size_t max_file_bytes, size_t max_files)
+    : m_monitor(monitor), m_path(path), m_interval(interval), m_max_file_bytes(max_file_bytes),
+      m_max_files(max_files > 0 ? max_files : 1) {}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+bool MetricsExporter::start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running || m_snapshot_thread.joinable()) {
+        return m_running;
+    }
+    if (!open_file()) {
+        return false;
+    }
+    m_running = true;
+    m_snapshots_done = false;
+    m_snapshot_thread = std::thread(&MetricsExporter::snapshot_loop, this);
+    m_writer_thread = std::thread(&MetricsExporter::writer_loop, this);
+    return true;
+}
+
+void MetricsExporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_snapshot_cv.notify_one();
+    if (m_snapshot_thread.joinable()) {
+        m_snapshot_thread.join();
+    }
+    if (m_writer_thread.joinable()) {
+        m_writer_thread.join();
+    }
+    m_file.close();
+}
+
+void MetricsExporter::snapshot_loop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto next = std::chrono::steady_clock::now();
+    while (m_running) {
+        next += m_interval;
+        if (m_snapshot_cv.wait_until(lock, next, [this] { return !m_running; })) {
+            break;
+        }
+        lock.unlock();
+        queue_snapshot();
+        lock.lock();
+    }
+    lock.unlock();
+
+    queue_snapshot();
+    lock.lock();
+    m_snapshots_done = true;
+    lock.unlock();
+    m_writer_cv.notify_one();
+}
+
+void MetricsExporter::queue_snapshot() {
+    const MetricsSnapshot snapshot = m_monitor.snapshot();
+    const auto wall_clock_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::string line = "{\"timestamp_ms\":" + std::to_string(wall_clock_ms) +
+                       ",\"uptime_seconds\":" + std::to_string(snapshot.uptime_seconds) +
+                       ",\"ring_overflows\":" + std::to_string(snapshot.ring_overflows) +
+                       ",\"metrics\":" + PerformanceMonitor::format_metrics_json(snapshot, true) + "}\n";
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending.size() + line.size() > MAX_PENDING_BYTES) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_pending += line;
+    }
+    m_writer_cv.notify_one();
+}
+
+void MetricsExporter::writer_loop() {
+    // The second buffer; its capacity is handed back to m_pending on each swap
+    std::string batch;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_writer_cv.wait(lock, [this] { return !m_pending.empty() || m_snapshots_done; });
+        if (m_pending.empty()) {
+            return;
+        }
+        batch.swap(m_pending);
+        lock.unlock();
+
+        if (m_file_bytes > 0 && m_file_bytes + batch.size() > m_max_file_bytes) {
+            rotate();
+        }
+        if (m_file.is_open()) {
+            m_file.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+            m_file.flush();
+            if (m_file) {
+                m_file_bytes += batch.size();
+            } else {
+                std::cerr << "Failed to write metrics to " << m_path << std::endl;
+                m_file.clear();
+            }
+        }
+        batch.clear();
+        lock.lock();
+    }
+}
+
+bool MetricsExporter::open_file() {
+    m_file.open(m_path, std::ios::out | std::ios::app);
+    if (!m_file.is_open()) {
+        std::cerr << "Failed to open metrics file " << m_path << std::endl;
+        return false;
+    }
+    m_file.seekp(0, std::ios::end);
+    m_file_bytes = static_cast<size_t>(m_file.tellp());
+    return true;
+}
+
+void MetricsExporter::rotate() {
+    m_file.close();
+    for (size_t index = m_max_files - 1; index > 0; --index) {
+        const std::string from = index == 1 ? m_path : m_path + "." + std::to_string(index - 1);
+        std::rename(from.c_str(), (m_path + "." + std::to_string(index)).c_str());
+    }
+    if (m_max_files == 1) {
+        std::remove(m_path.c_str());
+    }
+    // Leaves the file closed on failure; later batches are dropped
+    open_file();
+}
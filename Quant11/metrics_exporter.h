@@ -0,0 +1,67 @@
+#pragma once
+
+#include "performance_monitor.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Appends a metrics snapshot to a JSON lines file at a fixed interval. One
+// thread takes and formats snapshots into a pending buffer; a second swaps
+// that buffer out and writes it, so a slow disk delays only the writer.
+// Each line is {"timestamp_ms", "uptime_seconds", "ring_overflows",
+// "metrics"}, with "metrics" in the get_metrics_json() layout.
+//
+// When the file would grow past max_file_bytes it is rotated: path becomes
+// path.1, path.1 becomes path.2 and so on, keeping max_files files in all.
+class MetricsExporter {
+public:
+    MetricsExporter(const PerformanceMonitor& monitor, const std::string& path,
+                    std::chrono::milliseconds interval = std::chrono::seconds(1),
+                    size_t max_file_bytes = 64 * 1024 * 1024, size_t max_files = 5);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // Opens path for appending; false if it cannot be opened
+    bool start();
+    // Writes a final snapshot and everything still pending, then closes the file
+    void stop();
+
+    // Snapshots discarded because the writer fell too far behind
+    uint64_t get_dropped_snapshots() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    void snapshot_loop();
+    void writer_loop();
+    void queue_snapshot();
+    bool open_file();
+    void rotate();
+
+    const PerformanceMonitor& m_monitor;
+    std::string m_path;
+    std::chrono::milliseconds m_interval;
+    size_t m_max_file_bytes;
+    size_t m_max_files;
+
+    std::mutex m_mutex;
+    std::condition_variable m_snapshot_cv;
+    std::condition_variable m_writer_cv;
+    bool m_running = false;
+    // Set once the snapshot thread has queued its last line
+    bool m_snapshots_done = false;
+    // Lines waiting for the writer; swapped with the writer's buffer
+    std::string m_pending;
+    std::atomic<uint64_t> m_dropped{0};
+
+    // Writer thread only
+    std::ofstream m_file;
+    size_t m_file_bytes = 0;
+
+    std::thread m_snapshot_thread;
+    std::thread m_writer_thread;
+};
@@ -0,0 +1,93 @@
+#include "metrics_http_server.h"
+#include <iostream>
+#include <istream>
+#include <sstream>
+
+namespace {
+const size_t MAX_REQUEST_BYTES = 8192;
+const char* const OPENMETRICS_CONTENT_TYPE = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+std::string http_response(const std::string& status, const std::string& content_type, const std::string& body) {
+    return "HTTP/1.1 " + status + "\r\n"
+           "Content-Type: " + content_type + "\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+           "Connection: close\r\n\r\n" + body;
+}
+}
+
+MetricsHttpServer::MetricsHttpServer(const PerformanceMonitor& monitor, uint16_t port, const std::string& address)
+    : m_monitor(monitor), m_address(address), m_port(port), m_acceptor(m_io_service) {}
+
+MetricsHttpServer::~MetricsHttpServer() {
+    stop();
+}
+
+bool MetricsHttpServer::start() {
+    boost::system::error_code ec;
+    const tcp::endpoint endpoint(boost::asio::ip::address::from_string(m_address, ec), m_port);
+    if (!ec) m_acceptor.open(endpoint.protocol(), ec);
+    if (!ec) m_acceptor.set_option(tcp::acceptor::reuse_address(true), ec);
+    if (!ec) m_acceptor.bind(endpoint, ec);
+    if (!ec) m_acceptor.listen(boost::asio::socket_base::max_connections, ec);
+    if (ec) {
+        std::cerr << "Metrics endpoint failed on " << m_address << ":" << m_port << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    accept();
+    m_thread = std::thread([this] { m_io_service.run(); });
+    return true;
+}
+
+void MetricsHttpServer::stop() {
+    m_io_service.stop();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void MetricsHttpServer::accept() {
+    auto session = std::make_shared<Session>(m_io_service, MAX_REQUEST_BYTES);
+    m_acceptor.async_accept(session->socket, [this, session](const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        if (!ec) {
+            boost::asio::async_read_until(session->socket, session->request, "\r\n\r\n",
+                [this, session](const boost::system::error_code& read_ec, size_t) {
+                    on_request(session, read_ec);
+                });
+        }
+        accept();
+    });
+}
+
+void MetricsHttpServer::on_request(const std::shared_ptr<Session>& session, const boost::system::error_code& ec) {
+    if (ec) {
+        return;  // Includes oversized requests; dropping the session closes the socket
+    }
+    std::istream stream(&session->request);
+    std::string request_line;
+    std::getline(stream, request_line);
+
+    session->response = make_response(request_line);
+    boost::asio::async_write(session->socket, boost::asio::buffer(session->response),
+        [session](const boost::system::error_code&, size_t) {
+            boost::system::error_code ignored;
+            session->socket.shutdown(tcp::socket::shutdown_both, ignored);
+        });
+}
+
+std::string MetricsHttpServer::make_response(const std::string& request_line) const {
+    std::istringstream parts(request_line);
+    std::string method, target;
+    parts >> method >> target;
+
+    if (method != "GET") {
+        return http_response("405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+    }
+    if (target.substr(0, target.find('?')) != "/metrics") {
+        return http_response("404 Not Found", "text/plain", "Try /metrics\n");
+    }
+    return http_response("200 OK", OPENMETRICS_CONTENT_TYPE, m_monitor.get_metrics_openmetrics());
+}
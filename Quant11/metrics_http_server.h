@@ -0,0 +1,46 @@
+#pragma once
+
+#include "performance_monitor.h"
+#include <boost/asio.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Minimal HTTP endpoint for Prometheus-compatible scrapers: GET /metrics
+// returns the monitor's OpenMetrics exposition. Requests are served one at a
+// time on the server's own thread, so scrapes never run on a recording thread.
+class MetricsHttpServer {
+public:
+    MetricsHttpServer(const PerformanceMonitor& monitor, uint16_t port,
+                      const std::string& address = "127.0.0.1");
+    ~MetricsHttpServer();
+
+    MetricsHttpServer(const MetricsHttpServer&) = delete;
+    MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+    // Binds and starts serving; false if the address cannot be bound
+    bool start();
+    void stop();
+
+private:
+    using tcp = boost::asio::ip::tcp;
+
+    struct Session {
+        Session(boost::asio::io_service& io_service, size_t max_request_bytes)
+            : socket(io_service), request(max_request_bytes) {}
+        tcp::socket socket;
+        boost::asio::streambuf request;
+        std::string response;
+    };
+
+    void accept();
+    void on_request(const std::shared_ptr<Session>& session, const boost::system::error_code& ec);
+    std::string make_response(const std::string& request_line) const;
+
+    const PerformanceMonitor& m_monitor;
+    std::string m_address;
+    uint16_t m_port;
+    boost::asio::io_service m_io_service;
+    tcp::acceptor m_acceptor;
+    std::thread m_thread;
+};
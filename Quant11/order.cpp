@@ -0,0 +1,71 @@
+#include "order.h"
+
+namespace {
+const char* const SIDE_NAMES[] = {"buy", "sell"};
+const char* const TYPE_NAMES[] = {"limit", "market", "stop_limit", "stop_market"};
+const char* const STATUS_NAMES[] = {"pending", "open", "filled", "rejected", "cancelled", "untriggered"};
+
+template <typename Enum, size_t N>
+bool parse_name(const char* const (&names)[N], const std::string& text, Enum& value) {
+    for (size_t i = 0; i < N; ++i) {
+        if (text == names[i]) {
+            value = static_cast<Enum>(i);
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+const char* to_string(OrderSide side) {
+    return SIDE_NAMES[static_cast<size_t>(side)];
+}
+
+const char* to_string(OrderType type) {
+    return TYPE_NAMES[static_cast<size_t>(type)];
+}
+
+const char* to_string(OrderStatus status) {
+    return status < OrderStatus::Count ? STATUS_NAMES[static_cast<size_t>(status)] : "unknown";
+}
+
+bool parse_order_side(const std::string& text, OrderSide& side) {
+    return parse_name(SIDE_NAMES, text, side);
+}
+
+bool parse_order_type(const std::string& text, OrderType& type) {
+    return parse_name(TYPE_NAMES, text, type);
+}
+
+bool parse_order_status(const std::string& text, OrderStatus& status) {
+    return parse_name(STATUS_NAMES, text, status);
+}
+
+uint32_t InstrumentRegistry::intern(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_ids.find(name);
+    if (it != m_ids.end()) {
+        return it->second;
+    }
+    const uint32_t id = static_cast<uint32_t>(m_names.size());
+    m_names.push_back(name);
+    m_ids.emplace(name, id);
+    return id;
+}
+
+uint32_t InstrumentRegistry::find(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_ids.find(name);
+    return it != m_ids.end() ? it->second : INVALID_ID;
+}
+
+const std::string& InstrumentRegistry::name(uint32_t id) const {
+    static const std::string unknown;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return id < m_names.size() ? m_names[id] : unknown;
+}
+
+size_t InstrumentRegistry::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_names.size();
+}
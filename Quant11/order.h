@@ -0,0 +1,151 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+enum class OrderSide : uint8_t {
+    Buy,
+    Sell
+};
+
+enum class OrderType : uint8_t {
+    Limit,
+    Market,
+    StopLimit,
+    StopMarket
+};
+
+enum class OrderStatus : uint8_t {
+    // Sent, not yet acknowledged by the exchange
+    Pending,
+    Open,
+    Filled,
+    Rejected,
+    Cancelled,
+    Untriggered,
+    Count
+};
+
+const size_t ORDER_STATUS_COUNT = static_cast<size_t>(OrderStatus::Count);
+
+// Live on the exchange, or about to be
+inline bool is_working(OrderStatus status) {
+    return status == OrderStatus::Pending || status == OrderStatus::Open || status == OrderStatus::Untriggered;
+}
+
+// Exchange spellings ("buy", "limit", "open", ...); parse functions return
+// false for anything else
+const char* to_string(OrderSide side);
+const char* to_string(OrderType type);
+const char* to_string(OrderStatus status);
+bool parse_order_side(const std::string& text, OrderSide& side);
+bool parse_order_type(const std::string& text, OrderType& type);
+bool parse_order_status(const std::string& text, OrderStatus& status);
+
+// Prices and amounts in units of 1e-8, exact for every exchange tick size
+const int64_t FIXED_POINT_SCALE = 100000000;
+
+inline int64_t to_fixed_point(double value) {
+    return std::llround(value * FIXED_POINT_SCALE);
+}
+
+inline double from_fixed_point(int64_t value) {
+    return static_cast<double>(value) / FIXED_POINT_SCALE;
+}
+
+// Exchange order id stored inline and NUL-padded, so ids compare and hash
+// without touching the heap
+struct OrderId {
+    static const size_t MAX_LENGTH = 31;
+    char value[MAX_LENGTH + 1];
+
+    // False if text is empty or longer than MAX_LENGTH
+    static bool parse(const std::string& text, OrderId& id) {
+        if (text.empty() || text.size() > MAX_LENGTH) {
+            return false;
+        }
+        std::memset(id.value, 0, sizeof(id.value));
+        text.copy(id.value, text.size());
+        return true;
+    }
+
+    std::string str() const { return std::string(value, strnlen(value, sizeof(value))); }
+};
+
+inline bool operator==(const OrderId& lhs, const OrderId& rhs) {
+    return std::memcmp(lhs.value, rhs.value, sizeof(lhs.value)) == 0;
+}
+
+inline bool operator!=(const OrderId& lhs, const OrderId& rhs) {
+    return !(lhs == rhs);
+}
+
+namespace std {
+template <>
+struct hash<OrderId> {
+    size_t operator()(const OrderId& id) const {
+        // FNV-1a over the id's characters
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(id.value) && id.value[i] != '\0'; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(id.value[i])) * 1099511628211ull;
+        }
+        return static_cast<size_t>(hash);
+    }
+};
+}
+
+// One order in a single cache line. Instruments are ids from an
+// InstrumentRegistry; strings only appear at the API boundary (OrderDetails).
+struct Order {
+    OrderId order_id;
+    uint32_t instrument_id;
+    OrderSide side;
+    OrderType type;
+    OrderStatus status;
+    // Fixed point, see FIXED_POINT_SCALE
+    int64_t price;
+    int64_t amount;
+    // Nanoseconds since the Unix epoch
+    uint64_t timestamp_ns;
+};
+
+static_assert(std::is_trivially_copyable<Order>::value, "Order must stay trivially copyable");
+static_assert(sizeof(Order) <= 64, "Order should fit in one cache line");
+
+// Order as exchanged with the API and shown to users
+struct OrderDetails {
+    std::string order_id;
+    std::string symbol;
+    std::string side;
+    std::string type;
+    double price;
+    double amount;
+    std::string status;
+    uint64_t timestamp_ns;
+};
+
+// Assigns each instrument name a dense id. Ids are never reused, and names
+// stay valid for the registry's lifetime.
+class InstrumentRegistry {
+public:
+    static const uint32_t INVALID_ID = UINT32_MAX;
+
+    uint32_t intern(const std::string& name);
+    // INVALID_ID if the name was never interned
+    uint32_t find(const std::string& name) const;
+    // Empty for unknown ids
+    const std::string& name(uint32_t id) const;
+    size_t size() const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, uint32_t> m_ids;
+    // A deque keeps references stable as it grows
+    std::deque<std::string> m_names;
+};
@@ -0,0 +1,455 @@
+#include "order_journal.h"
+#if ORDER_JOURNAL_SUPPORTED
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+const char JOURNAL_MAGIC[8] = {'Q', 'J', 'R', 'N', 'L', '0', '0', '1'};
+const char SNAPSHOT_MAGIC[8] = {'Q', 'S', 'N', 'A', 'P', '0', '0', '1'};
+// size, checksum, type
+const size_t RECORD_HEADER_BYTES = 9;
+// Journals start at this size and double when full
+const size_t INITIAL_SEGMENT_BYTES = 16 * 1024 * 1024;
+const size_t INITIAL_BATCH_BYTES = 64 * 1024;
+
+uint32_t record_checksum(uint8_t type, const char* payload, uint32_t size) {
+    // FNV-1a over the type and payload
+    uint32_t hash = (2166136261u ^ type) * 16777619u;
+    for (uint32_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(payload[i])) * 16777619u;
+    }
+    return hash;
+}
+
+#if ORDER_JOURNAL_SUPPORTED
+std::string generation_path(const std::string& directory, const char* prefix, uint64_t generation) {
+    return directory + "/" + prefix + "." + std::to_string(generation);
+}
+
+// Generations of the directory's journal.<n> and snapshot.<n> files, ascending
+void list_generations(const std::string& directory, std::vector<uint64_t>& journals,
+                      std::vector<uint64_t>& snapshots) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return;
+    }
+    while (dirent* entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        const size_t dot = name.find('.');
+        if (dot == std::string::npos || dot + 1 == name.size() ||
+            name.find_first_not_of("0123456789", dot + 1) != std::string::npos) {
+            continue;
+        }
+        const uint64_t generation = std::strtoull(name.c_str() + dot + 1, nullptr, 10);
+        const std::string prefix = name.substr(0, dot);
+        if (prefix == "journal") {
+            journals.push_back(generation);
+        } else if (prefix == "snapshot") {
+            snapshots.push_back(generation);
+        }
+    }
+    closedir(dir);
+    std::sort(journals.begin(), journals.end());
+    std::sort(snapshots.begin(), snapshots.end());
+}
+
+bool read_file(const std::string& path, std::string& data) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    return static_cast<bool>(file.read(&data[0], static_cast<std::streamsize>(data.size())));
+}
+
+// Feeds every intact record after the magic to handler and returns the
+// offset just past the last one; 0 if the magic is missing.
+size_t read_records(const char* data, size_t length, const char (&magic)[8],
+                    const OrderJournal::RecordHandler& handler) {
+    if (length < sizeof(magic) || std::memcmp(data, magic, sizeof(magic)) != 0) {
+        return 0;
+    }
+    size_t offset = sizeof(magic);
+    while (offset + RECORD_HEADER_BYTES <= length) {
+        uint32_t size = 0;
+        uint32_t checksum = 0;
+        std::memcpy(&size, data + offset, sizeof(size));
+        std::memcpy(&checksum, data + offset + 4, sizeof(checksum));
+        const uint8_t type = static_cast<uint8_t>(data[offset + 8]);
+        const char* payload = data + offset + RECORD_HEADER_BYTES;
+        // Type 0 is unwritten space after a crash
+        if (type == 0 || size > length - offset - RECORD_HEADER_BYTES ||
+            record_checksum(type, payload, size) != checksum) {
+            break;
+        }
+        handler(type, payload, size);
+        offset += RECORD_HEADER_BYTES + size;
+    }
+    return offset;
+}
+
+// True if the data ends cleanly or in zero padding after its last record,
+// rather than in a torn or corrupt one
+bool intact(const std::string& data, size_t end) {
+    return end > 0 && data.find_first_not_of('\0', end) == std::string::npos;
+}
+#endif
+}
+
+OrderJournal::OrderJournal(const std::string& directory, std::chrono::microseconds commit_interval)
+    : m_directory(directory), m_commit_interval(commit_interval) {}
+
+OrderJournal::~OrderJournal() {
+    close();
+}
+
+bool OrderJournal::open() {
+#if !ORDER_JOURNAL_SUPPORTED
+    std::cerr << "Order journaling is not supported on this platform" << std::endl;
+    return false;
+#else
+    if (mkdir(m_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Failed to create journal directory " << m_directory << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::vector<uint64_t> journals;
+    std::vector<uint64_t> snapshots;
+    list_generations(m_directory, journals, snapshots);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running) {
+        return true;
+    }
+    m_generation = 1 + std::max(journals.empty() ? 0 : journals.back(), snapshots.empty() ? 0 : snapshots.back());
+    m_running = true;
+    m_failed = false;
+    m_committer = std::thread(&OrderJournal::commit_loop, this);
+    return true;
+#endif
+}
+
+bool OrderJournal::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_cv.notify_one();
+    if (m_committer.joinable()) {
+        m_committer.join();
+    }
+    return healthy();
+}
+
+bool OrderJournal::append(uint8_t type, const void* payload, uint32_t size) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_failed) {
+            return false;
+        }
+        wake = m_batches.empty();
+        if (m_batches.empty() || m_batches.back().generation != m_generation) {
+            m_batches.push_back(Batch{m_generation, std::string()});
+            m_batches.back().records.swap(m_spare);
+            if (m_batches.back().records.capacity() < INITIAL_BATCH_BYTES) {
+                m_batches.back().records.reserve(INITIAL_BATCH_BYTES);
+            }
+        }
+        encode(type, payload, size, m_batches.back().records);
+    }
+    // The committer sleeps until there is something to commit
+    if (wake) {
+        m_cv.notify_one();
+    }
+    return true;
+}
+
+bool OrderJournal::healthy() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_failed;
+}
+
+uint64_t OrderJournal::rotate() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return ++m_generation;
+}
+
+void OrderJournal::encode(uint8_t type, const void* payload, uint32_t size, std::string& out) {
+    const char* bytes = static_cast<const char*>(payload);
+    const uint32_t checksum = record_checksum(type, bytes, size);
+    char header[RECORD_HEADER_BYTES];
+    std::memcpy(header, &size, sizeof(size));
+    std::memcpy(header + 4, &checksum, sizeof(checksum));
+    header[8] = static_cast<char>(type);
+    out.append(header, sizeof(header));
+    out.append(bytes, size);
+}
+
+#if ORDER_JOURNAL_SUPPORTED
+bool OrderJournal::write_snapshot(uint64_t generation, const std::string& records) {
+    const std::string path = generation_path(m_directory, "snapshot", generation);
+    const std::string temporary = path + ".tmp";
+    const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to create snapshot " << temporary << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::string data(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    data += records;
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+        if (result < 0 && errno != EINTR) {
+            break;
+        }
+        written += result > 0 ? static_cast<size_t>(result) : 0;
+    }
+    const bool complete = written == data.size() && fsync(fd) == 0;
+    ::close(fd);
+    if (!complete || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write snapshot " << path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    // Make the rename durable before dropping what it replaces
+    const int dir_fd = ::open(m_directory.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        ::close(dir_fd);
+    }
+
+    // From here on the committer drops batches of older generations rather
+    // than recreate the journals deleted below
+    std::lock_guard<std::mutex> lock(m_files_mutex);
+    m_snapshot_generation = std::max(m_snapshot_generation, generation);
+    std::vector<uint64_t> journals;
+    std::vector<uint64_t> snapshots;
+    list_generations(m_directory, journals, snapshots);
+    for (uint64_t old : journals) {
+        if (old < generation) {
+            std::remove(generation_path(m_directory, "journal", old).c_str());
+        }
+    }
+    for (uint64_t old : snapshots) {
+        if (old < generation) {
+            std::remove(generation_path(m_directory, "snapshot", old).c_str());
+        }
+    }
+    return true;
+}
+
+bool OrderJournal::replay(const std::string& directory, const RecordHandler& handler) {
+    std::vector<uint64_t> journals;
+    std::vector<uint64_t> snapshots;
+    list_generations(directory, journals, snapshots);
+
+    uint64_t first_journal = 0;
+    std::string data;
+    if (!snapshots.empty()) {
+        const std::string path = generation_path(directory, "snapshot", snapshots.back());
+        // Snapshots are renamed into place only once complete
+        if (!read_file(path, data) || !intact(data, read_records(data.data(), data.size(), SNAPSHOT_MAGIC, handler))) {
+            std::cerr << "Corrupt snapshot " << path << std::endl;
+            return false;
+        }
+        first_journal = snapshots.back();
+    }
+    for (uint64_t generation : journals) {
+        if (generation < first_journal) {
+            continue;
+        }
+        const std::string path = generation_path(directory, "journal", generation);
+        if (read_file(path, data) && !intact(data, read_records(data.data(), data.size(), JOURNAL_MAGIC, handler))) {
+            std::cerr << "Journal " << path << " ends in a torn record; replayed up to it" << std::endl;
+        }
+    }
+    return true;
+}
+#else
+bool OrderJournal::write_snapshot(uint64_t, const std::string&) {
+    std::cerr << "Order journaling is not supported on this platform" << std::endl;
+    return false;
+}
+
+bool OrderJournal::replay(const std::string&, const RecordHandler&) {
+    std::cerr << "Order journaling is not supported on this platform" << std::endl;
+    return false;
+}
+#endif
+
+void OrderJournal::commit_loop() {
+    std::vector<Batch> batches;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_cv.wait(lock, [this] { return !m_running || !m_batches.empty(); });
+        // Let the group fill for one interval before paying for the sync
+        m_cv.wait_for(lock, m_commit_interval, [this] { return !m_running; });
+        const bool stopping = !m_running;
+        batches.swap(m_batches);
+        lock.unlock();
+
+        const bool committed = commit(batches);
+
+        lock.lock();
+        if (!committed && !m_failed) {
+            m_failed = true;
+            // Nothing staged from here on can follow the lost group
+            m_batches.clear();
+        }
+        // Hand one buffer back so appends rarely allocate
+        if (!batches.empty() && m_spare.capacity() < batches.front().records.capacity()) {
+            m_spare.swap(batches.front().records);
+            m_spare.clear();
+        }
+        batches.clear();
+        if (stopping) {
+            break;
+        }
+    }
+    lock.unlock();
+    close_segment();
+}
+
+bool OrderJournal::commit(std::vector<Batch>& batches) {
+    for (const Batch& batch : batches) {
+        if (m_segment.fd < 0 || m_segment.generation != batch.generation) {
+            if (!close_segment()) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(m_files_mutex);
+            if (batch.generation < m_snapshot_generation) {
+                continue;  // Covered by a snapshot; its journal is gone
+            }
+            if (!open_segment(batch.generation)) {
+                return false;
+            }
+        }
+        if (!write_segment(batch.records)) {
+            return false;
+        }
+    }
+    return sync_segment();
+}
+
+#if ORDER_JOURNAL_SUPPORTED
+bool OrderJournal::open_segment(uint64_t generation) {
+    const std::string path = generation_path(m_directory, "journal", generation);
+    // Never truncate: an existing journal holds records already synced
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        std::cerr << "Failed to open journal " << path << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    const size_t existing = static_cast<size_t>(info.st_size);
+    const size_t capacity = std::max(INITIAL_SEGMENT_BYTES, existing);
+    if (existing < capacity && ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+        std::cerr << "Failed to size journal " << path << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        std::cerr << "Failed to map journal " << path << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    m_segment.generation = generation;
+    m_segment.fd = fd;
+    m_segment.data = static_cast<char*>(data);
+    m_segment.capacity = capacity;
+    // Resume after the last intact record, clearing any torn tail
+    const size_t end = read_records(m_segment.data, existing, JOURNAL_MAGIC,
+                                    [](uint8_t, const char*, uint32_t) {});
+    size_t dirty = existing;
+    while (dirty > end && m_segment.data[dirty - 1] == 0) {
+        --dirty;
+    }
+    std::memset(m_segment.data + end, 0, dirty - end);
+    m_segment.size = end;
+    m_segment.synced = end;
+    return end > 0 || write_segment(std::string(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)));
+}
+
+bool OrderJournal::write_segment(const std::string& records) {
+    if (m_segment.size + records.size() > m_segment.capacity) {
+        // Map the grown file before unmapping the old view, so a failure
+        // leaves the segment as it was
+        const size_t capacity = std::max(m_segment.capacity * 2, m_segment.size + records.size());
+        void* data = MAP_FAILED;
+        if (ftruncate(m_segment.fd, static_cast<off_t>(capacity)) == 0) {
+            data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_segment.fd, 0);
+        }
+        if (data == MAP_FAILED) {
+            std::cerr << "Failed to grow journal " << m_segment.generation << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        munmap(m_segment.data, m_segment.capacity);
+        m_segment.data = static_cast<char*>(data);
+        m_segment.capacity = capacity;
+    }
+    std::memcpy(m_segment.data + m_segment.size, records.data(), records.size());
+    m_segment.size += records.size();
+    return true;
+}
+
+bool OrderJournal::sync_segment() {
+    if (!m_segment.data || m_segment.synced == m_segment.size) {
+        return true;
+    }
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t start = m_segment.synced / page * page;
+    if (msync(m_segment.data + start, m_segment.size - start, MS_SYNC) != 0) {
+        std::cerr << "Failed to sync journal " << m_segment.generation << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    m_segment.synced = m_segment.size;
+    return true;
+}
+
+bool OrderJournal::close_segment() {
+    if (m_segment.fd < 0) {
+        return true;
+    }
+    const bool synced = sync_segment();
+    munmap(m_segment.data, m_segment.capacity);
+    // Drop the unused tail so a clean journal ends at its last record
+    if (ftruncate(m_segment.fd, static_cast<off_t>(m_segment.size)) != 0) {
+        std::cerr << "Failed to trim journal " << m_segment.generation << std::endl;
+    }
+    ::close(m_segment.fd);
+    m_segment = Segment();
+    return synced;
+}
+#else
+// Unreachable: open() never starts the committer here
+bool OrderJournal::open_segment(uint64_t) {
+    return false;
+}
+
+bool OrderJournal::write_segment(const std::string&) {
+    return false;
+}
+
+bool OrderJournal::sync_segment() {
+    return false;
+}
+
+bool OrderJournal::close_segment() {
+    return true;
+}
+#endif
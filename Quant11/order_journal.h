@@ -0,0 +1,120 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define ORDER_JOURNAL_SUPPORTED 0
+#else
+#define ORDER_JOURNAL_SUPPORTED 1
+#endif
+
+// Write-ahead log of typed binary records, used by OrderManager to survive
+// restarts. append() only copies the record into a staging buffer; a
+// committer thread copies staged records into a memory-mapped file and
+// syncs them as one group every commit interval, so a crash loses at most
+// the last interval.
+//
+// Files live in one directory and are numbered by generation:
+// journal.<n> holds the records appended during generation n, and
+// snapshot.<n> the full state as of the start of generation n. Recovery
+// replays the latest snapshot followed by every journal from its
+// generation on. A torn record at the end of a journal ends that journal.
+//
+// A failure to write or sync a group stops the journal: the group is
+// dropped, and append() and close() return false from then on, since the
+// journal no longer holds every change.
+//
+// POSIX only (mmap/msync). Where ORDER_JOURNAL_SUPPORTED is 0, open(),
+// replay() and write_snapshot() report that journaling is not supported and
+// return false, so OrderManager::open_journal fails.
+class OrderJournal {
+public:
+    using RecordHandler = std::function<void(uint8_t type, const char* payload, uint32_t size)>;
+
+    explicit OrderJournal(const std::string& directory,
+                          std::chrono::microseconds commit_interval = std::chrono::milliseconds(1));
+    ~OrderJournal();
+
+    OrderJournal(const OrderJournal&) = delete;
+    OrderJournal& operator=(const OrderJournal&) = delete;
+
+    // Starts a generation after every file already in the directory and the
+    // committer thread; false if the directory is unusable
+    bool open();
+    // Commits everything appended so far, then stops. False if any record
+    // appended since open() could not be made durable.
+    bool close();
+
+    // Any thread; type must be non-zero. False, without staging the record,
+    // once a commit has failed.
+    bool append(uint8_t type, const void* payload, uint32_t size);
+    // False once a commit has failed
+    bool healthy() const;
+    // Records appended from now on go to a new generation, whose number is
+    // returned for write_snapshot
+    uint64_t rotate();
+    // Durably writes snapshot.<generation> from encoded records, then deletes
+    // the journals and snapshots it supersedes. Records of earlier
+    // generations still staged are covered by the snapshot and dropped.
+    bool write_snapshot(uint64_t generation, const std::string& records);
+
+    // Appends one encoded record to out, for building snapshots
+    static void encode(uint8_t type, const void* payload, uint32_t size, std::string& out);
+    // Feeds the latest snapshot's records and then the journal tail to
+    // handler, oldest first. True when the directory is empty or missing.
+    static bool replay(const std::string& directory, const RecordHandler& handler);
+
+private:
+    // Appended records of one generation, waiting for the committer
+    struct Batch {
+        uint64_t generation;
+        std::string records;
+    };
+
+    // The mapped journal file being written
+    struct Segment {
+        uint64_t generation = 0;
+        int fd = -1;
+        char* data = nullptr;
+        size_t capacity = 0;
+        size_t size = 0;
+        size_t synced = 0;
+    };
+
+    void commit_loop();
+    bool commit(std::vector<Batch>& batches);
+    // Opens journal.<generation>, resuming after its last intact record if
+    // it already exists
+    bool open_segment(uint64_t generation);
+    bool write_segment(const std::string& records);
+    bool sync_segment();
+    // Syncs, unmaps and trims the segment; false if the sync failed
+    bool close_segment();
+
+    std::string m_directory;
+    std::chrono::microseconds m_commit_interval;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_running = false;
+    bool m_failed = false;
+    uint64_t m_generation = 0;
+    std::vector<Batch> m_batches;
+    // A committed batch's buffer, reused by the next batch
+    std::string m_spare;
+
+    // Orders the committer creating journal files against write_snapshot
+    // deleting the generations it supersedes
+    std::mutex m_files_mutex;
+    uint64_t m_snapshot_generation = 0;
+
+    // Committer thread only
+    Segment m_segment;
+    std::thread m_committer;
+};
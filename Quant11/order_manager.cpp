@@ -3,15 +3,49 @@
 #include "token_manager.h"
 #include <drogon/HttpClient.h>
 #include <json/json.h>
+#include <cstring>
 #include <iostream>
-#include <future>
 #include <algorithm>
+#include <chrono>
+#include <initializer_list>
 
-bool OrderManager::PlaceOrder(const OrderParams& params, const std::string& side, std::string& response) const
+namespace {
+// Journal record types. Payloads: the Order followed by its instrument name
+// (instrument ids are not stable across restarts); the OrderId followed by
+// the new status byte; the OrderId alone.
+const uint8_t JOURNAL_ORDER_ADDED = 1;
+const uint8_t JOURNAL_STATUS_CHANGED = 2;
+const uint8_t JOURNAL_ORDER_REMOVED = 3;
+}
+
+void PendingOrder::complete(const OrderAck& ack) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ack = ack;
+    m_ready.store(true, std::memory_order_release);
+    m_cv.notify_all();
+}
+
+void PendingOrder::wait() const {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return ready(); });
+}
+
+bool PendingOrder::wait_for(std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_cv.wait_for(lock, timeout, [this] { return ready(); });
+}
+
+void OrderManager::PlaceOrderAsync(const OrderParams& params, const std::string& side, OrderCallback on_ack) const
 {
+    // Covers the round trip; finished on whichever thread sees the answer
+    const OrderManagerInstrumentation::AsyncSpan span(m_instrumentation, BuiltinMetric::OrderPlacement);
     if (!RefreshTokenIfNeeded())
     {
-        return false;
+        span.finish();
+        OrderAck ack;
+        ack.response = "Failed to refresh access token";
+        on_ack(ack);
+        return;
     }
 
     const std::string access_token = m_token_manager.GetAccessToken();
@@ -40,85 +74,399 @@ bool OrderManager::PlaceOrder(const OrderParams& params, const std::string& side
     req->addHeader("Authorization", "Bearer " + access_token);
     req->addHeader("Content-Type", "application/json");
 
-    std::promise<bool> promise;
-    auto future = promise.get_future();
-
+    // Everything the callback needs is captured by value: it may run after
+    // this call, and the caller, have moved on
     m_client->sendRequest(
         req,
-        [&](const drogon::ReqResult& result, const drogon::HttpResponsePtr& http_response)
+        [span, on_ack](const drogon::ReqResult& result, const drogon::HttpResponsePtr& http_response)
         {
+            span.finish();
+            OrderAck ack;
             if (result == drogon::ReqResult::Ok && http_response->getStatusCode() == drogon::k200OK)
             {
-                response = http_response->body();
-                UtilityManager::DisplayJsonResponse(response);
-                promise.set_value(true);
+                ack.success = true;
+                ack.response = http_response->body();
             }
             else
             {
                 std::cerr << "Failed to place order.\n";
-                response = "Failed to place order";
-                promise.set_value(false);
+                ack.response = "Failed to place order";
             }
+            on_ack(ack);
         });
+}
 
-    return future.get();
+std::shared_ptr<PendingOrder> OrderManager::PlaceOrderAsync(const OrderParams& params, const std::string& side) const
+{
+    auto pending = std::make_shared<PendingOrder>();
+    PlaceOrderAsync(params, side, [pending](const OrderAck& ack) { pending->complete(ack); });
+    return pending;
 }
 
-void OrderManager::add_order(const Order& order) {
-    std::lock_guard<std::mutex> lock(m_orders_mutex);
-    m_orders[order.order_id] = order;
+bool OrderManager::PlaceOrder(const OrderParams& params, const std::string& side, std::string& response) const
+{
+    const std::shared_ptr<PendingOrder> pending = PlaceOrderAsync(params, side);
+    pending->wait();
+    response = pending->ack().response;
+    if (pending->ack().success)
+    {
+        UtilityManager::DisplayJsonResponse(response);
+    }
+    return pending->ack().success;
 }
 
-void OrderManager::update_order_status(const std::string& order_id, const std::string& status) {
-    std::lock_guard<std::mutex> lock(m_orders_mutex);
-    auto it = m_orders.find(order_id);
-    if (it != m_orders.end()) {
-        it->second.status = status;
+bool OrderManager::to_order(const OrderDetails& details, Order& order) {
+    if (!OrderId::parse(details.order_id, order.order_id) ||
+        !parse_order_side(details.side, order.side) ||
+        !parse_order_type(details.type, order.type) ||
+        !parse_order_status(details.status, order.status)) {
+        std::cerr << "Invalid order " << details.order_id << std::endl;
+        return false;
     }
+    order.instrument_id = m_instruments.intern(details.symbol);
+    order.price = to_fixed_point(details.price);
+    order.amount = to_fixed_point(details.amount);
+    order.timestamp_ns = details.timestamp_ns;
+    return true;
 }
 
-void OrderManager::remove_order(const std::string& order_id) {
-    std::lock_guard<std::mutex> lock(m_orders_mutex);
-    m_orders.erase(order_id);
+OrderDetails OrderManager::to_details(const Order& order) const {
+    OrderDetails details;
+    details.order_id = order.order_id.str();
+    details.symbol = m_instruments.name(order.instrument_id);
+    details.side = to_string(order.side);
+    details.type = to_string(order.type);
+    details.price = from_fixed_point(order.price);
+    details.amount = from_fixed_point(order.amount);
+    details.status = to_string(order.status);
+    details.timestamp_ns = order.timestamp_ns;
+    return details;
 }
 
-Order OrderManager::get_order(const std::string& order_id) const {
-    std::lock_guard<std::mutex> lock(m_orders_mutex);
-    auto it = m_orders.find(order_id);
-    if (it != m_orders.end()) {
-        return it->second;
+OrderManager::OrderManager(size_t shard_count)
+    : m_shards(std::max<size_t>(shard_count, 1)),
+      m_routes(std::max<size_t>(shard_count, 1)) {}
+
+void OrderManager::OrderShard::index(const Order& order, size_t local_id) {
+    if (local_id >= by_instrument.size()) {
+        by_instrument.resize(local_id + 1);
     }
-    return Order{};
+    by_instrument[local_id].insert(&order);
+    by_status[static_cast<size_t>(order.status)].insert(&order);
+}
+
+void OrderManager::OrderShard::unindex(const Order& order, size_t local_id) {
+    by_instrument[local_id].erase(&order);
+    by_status[static_cast<size_t>(order.status)].erase(&order);
+}
+
+void OrderManager::added_record(const Order& order, std::string& payload) const {
+    payload.assign(reinterpret_cast<const char*>(&order), sizeof(order));
+    payload += m_instruments.name(order.instrument_id);
+}
+
+bool OrderManager::journal_added(const Order& order) {
+    // Reused so journaling does not allocate once warm
+    thread_local std::string payload;
+    added_record(order, payload);
+    return m_journal->append(JOURNAL_ORDER_ADDED, payload.data(), static_cast<uint32_t>(payload.size()));
+}
+
+bool OrderManager::journal_status(const OrderId& order_id, OrderStatus status) {
+    char payload[sizeof(OrderId) + 1];
+    std::memcpy(payload, &order_id, sizeof(OrderId));
+    payload[sizeof(OrderId)] = static_cast<char>(status);
+    return m_journal->append(JOURNAL_STATUS_CHANGED, payload, sizeof(payload));
+}
+
+bool OrderManager::journal_removed(const OrderId& order_id) {
+    return m_journal->append(JOURNAL_ORDER_REMOVED, &order_id, sizeof(OrderId));
+}
+
+void OrderManager::apply_journal_record(uint8_t type, const char* payload, uint32_t size) {
+    OrderId order_id;
+    if (type == JOURNAL_ORDER_ADDED && size >= sizeof(Order)) {
+        Order order;
+        std::memcpy(&order, payload, sizeof(Order));
+        order.instrument_id = m_instruments.intern(std::string(payload + sizeof(Order), size - sizeof(Order)));
+        add_order(order);
+    } else if (type == JOURNAL_STATUS_CHANGED && size == sizeof(OrderId) + 1) {
+        std::memcpy(&order_id, payload, sizeof(OrderId));
+        update_order_status(order_id, static_cast<OrderStatus>(payload[sizeof(OrderId)]));
+    } else if (type == JOURNAL_ORDER_REMOVED && size == sizeof(OrderId)) {
+        std::memcpy(&order_id, payload, sizeof(OrderId));
+        remove_order(order_id);
+    } else {
+        std::cerr << "Skipping unknown journal record of type " << static_cast<int>(type) << std::endl;
+    }
+}
+
+bool OrderManager::open_journal(const std::string& directory) {
+    if (m_journal) {
+        return true;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    // Records are state-setting, so replaying changes the snapshot already
+    // reflects converges on the same state
+    const bool replayed = OrderJournal::replay(directory, [this](uint8_t type, const char* payload, uint32_t size) {
+        apply_journal_record(type, payload, size);
+    });
+    if (!replayed) {
+        return false;
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Recovered " << count_orders() << " orders from " << directory << " in "
+              << elapsed.count() << " us" << std::endl;
+
+    std::unique_ptr<OrderJournal> journal(new OrderJournal(directory));
+    if (!journal->open()) {
+        return false;
+    }
+    m_journal = std::move(journal);
+    // Compact what was just replayed
+    return write_snapshot();
+}
+
+bool OrderManager::write_snapshot() {
+    if (!m_journal) {
+        return false;
+    }
+    // Changes from here on land in the new generation's journal; the
+    // snapshot includes at least everything before it
+    const uint64_t generation = m_journal->rotate();
+    std::string records;
+    std::string payload;
+    for_each_order([this, &records, &payload](const Order& order) {
+        added_record(order, payload);
+        OrderJournal::encode(JOURNAL_ORDER_ADDED, payload.data(), static_cast<uint32_t>(payload.size()), records);
+    });
+    return m_journal->write_snapshot(generation, records);
+}
+
+bool OrderManager::close_journal() {
+    if (!m_journal) {
+        return true;
+    }
+    const bool committed = m_journal->close();
+    m_journal.reset();
+    return committed;
+}
+
+bool OrderManager::journal_healthy() const {
+    return !m_journal || m_journal->healthy();
+}
+
+bool OrderManager::find_route(const OrderId& order_id, uint32_t& instrument_id) const {
+    const RoutingShard& routes = route_for(order_id);
+    std::shared_lock<std::shared_timed_mutex> lock(routes.mutex);
+    auto it = routes.instruments.find(order_id);
+    if (it == routes.instruments.end()) {
+        return false;
+    }
+    instrument_id = it->second;
+    return true;
+}
+
+bool OrderManager::routed_to(const OrderId& order_id, const OrderShard& shard) const {
+    uint32_t instrument_id = 0;
+    return find_route(order_id, instrument_id) && &shard_for(instrument_id) == &shard;
+}
+
+bool OrderManager::add_order(const Order& order) {
+    if (order.status >= OrderStatus::Count) {
+        std::cerr << "Invalid status for order " << order.order_id.str() << std::endl;
+        return false;
+    }
+    bool rerouted = false;
+    uint32_t previous_instrument = 0;
+    {
+        RoutingShard& routes = route_for(order.order_id);
+        std::unique_lock<std::shared_timed_mutex> routing_lock(routes.mutex);
+        auto route = routes.instruments.emplace(order.order_id, order.instrument_id);
+        if (!route.second) {
+            rerouted = true;
+            previous_instrument = route.first->second;
+            route.first->second = order.instrument_id;
+        }
+    }
+
+    OrderShard& shard = shard_for(order.instrument_id);
+    if (rerouted && &shard_for(previous_instrument) != &shard) {
+        // Re-added under an instrument in another shard
+        OrderShard& previous = shard_for(previous_instrument);
+        std::unique_lock<std::shared_timed_mutex> lock(previous.mutex);
+        auto it = previous.orders.find(order.order_id);
+        if (it != previous.orders.end() && !routed_to(order.order_id, previous)) {
+            previous.unindex(it->second, local_index(it->second.instrument_id));
+            previous.orders.erase(it);
+        }
+    }
+
+    std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+    // A concurrent remove, or re-add elsewhere, of the same id since the
+    // route was written wins
+    if (!routed_to(order.order_id, shard)) {
+        return true;
+    }
+    auto result = shard.orders.emplace(order.order_id, order);
+    if (!result.second) {
+        shard.unindex(result.first->second, local_index(result.first->second.instrument_id));
+        result.first->second = order;
+    }
+    shard.index(result.first->second, local_index(order.instrument_id));
+    return !m_journal || journal_added(order);
+}
+
+bool OrderManager::add_order(const OrderDetails& details) {
+    Order order;
+    return to_order(details, order) && add_order(order);
+}
+
+bool OrderManager::update_order_status(const OrderId& order_id, OrderStatus status) {
+    if (status >= OrderStatus::Count) {
+        return false;
+    }
+    uint32_t instrument_id = 0;
+    if (!find_route(order_id, instrument_id)) {
+        return true;
+    }
+    OrderShard& shard = shard_for(instrument_id);
+    std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+    auto it = shard.orders.find(order_id);
+    if (it == shard.orders.end() || it->second.status == status) {
+        return true;
+    }
+    Order& order = it->second;
+    shard.by_status[static_cast<size_t>(order.status)].erase(&order);
+    order.status = status;
+    shard.by_status[static_cast<size_t>(status)].insert(&order);
+    return !m_journal || journal_status(order_id, status);
+}
+
+bool OrderManager::remove_order(const OrderId& order_id) {
+    uint32_t instrument_id = 0;
+    {
+        RoutingShard& routes = route_for(order_id);
+        std::unique_lock<std::shared_timed_mutex> routing_lock(routes.mutex);
+        auto route = routes.instruments.find(order_id);
+        if (route == routes.instruments.end()) {
+            return true;
+        }
+        instrument_id = route->second;
+        routes.instruments.erase(route);
+    }
+
+    OrderShard& shard = shard_for(instrument_id);
+    std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+    auto it = shard.orders.find(order_id);
+    // Re-added to this shard since the route was erased: the add is newer
+    if (it == shard.orders.end() || routed_to(order_id, shard)) {
+        return true;
+    }
+    shard.unindex(it->second, local_index(it->second.instrument_id));
+    shard.orders.erase(it);
+    return !m_journal || journal_removed(order_id);
+}
+
+bool OrderManager::get_order(const OrderId& order_id, Order& order) const {
+    uint32_t instrument_id = 0;
+    if (!find_route(order_id, instrument_id)) {
+        return false;
+    }
+    const OrderShard& shard = shard_for(instrument_id);
+    std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+    auto it = shard.orders.find(order_id);
+    if (it == shard.orders.end()) {
+        return false;
+    }
+    order = it->second;
+    return true;
 }
 
 std::vector<Order> OrderManager::get_all_orders() const {
-    std::lock_guard<std::mutex> lock(m_orders_mutex);
     std::vector<Order> orders;
-    orders.reserve(m_orders.size());
-    for (const auto& pair : m_orders) {
-        orders.push_back(pair.second);
-    }
+    for_each_order([&orders](const Order& order) { orders.push_back(order); });
     return orders;
 }
 
 std::vector<Order> OrderManager::get_orders_by_symbol(const std::string& symbol) const {
-    std::lock_guard<std::mutex> lock(m_orders_mutex);
+    const OrdersView view = view_orders_by_symbol(symbol);
+    return std::vector<Order>(view.begin(), view.end());
+}
+
+std::vector<Order> OrderManager::get_orders_by_status(OrderStatus status) const {
     std::vector<Order> orders;
-    for (const auto& pair : m_orders) {
-        if (pair.second.symbol == symbol) {
-            orders.push_back(pair.second);
-        }
-    }
+    for_each_order_by_status(status, [&orders](const Order& order) { orders.push_back(order); });
     return orders;
 }
 
-std::vector<Order> OrderManager::get_orders_by_status(const std::string& status) const {
-    std::lock_guard<std::mutex> lock(m_orders_mutex);
-    std::vector<Order> orders;
-    for (const auto& pair : m_orders) {
-        if (pair.second.status == status) {
-            orders.push_back(pair.second);
+OrderManager::OrdersView OrderManager::view_orders_by_symbol(const std::string& symbol) const {
+    static const std::unordered_set<const Order*> no_orders;
+    const uint32_t instrument_id = m_instruments.find(symbol);
+    if (instrument_id == InstrumentRegistry::INVALID_ID) {
+        return OrdersView(std::shared_lock<std::shared_timed_mutex>(), no_orders);
+    }
+    const OrderShard& shard = shard_for(instrument_id);
+    std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+    const size_t local_id = local_index(instrument_id);
+    if (local_id >= shard.by_instrument.size()) {
+        return OrdersView(std::move(lock), no_orders);
+    }
+    return OrdersView(std::move(lock), shard.by_instrument[local_id]);
+}
+
+size_t OrderManager::count_orders() const {
+    size_t count = 0;
+    for (const OrderShard& shard : m_shards) {
+        std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+        count += shard.orders.size();
+    }
+    return count;
+}
+
+size_t OrderManager::count_orders_by_symbol(const std::string& symbol) const {
+    return view_orders_by_symbol(symbol).size();
+}
+
+size_t OrderManager::count_orders_by_status(OrderStatus status) const {
+    size_t count = 0;
+    if (status >= OrderStatus::Count) {
+        return count;
+    }
+    for (const OrderShard& shard : m_shards) {
+        std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+        count += shard.by_status[static_cast<size_t>(status)].size();
+    }
+    return count;
+}
+
+double OrderManager::get_open_notional(const std::string& symbol) const {
+    double notional = 0.0;
+    for_each_order_by_symbol(symbol, [&notional](const Order& order) {
+        if (is_working(order.status)) {
+            notional += from_fixed_point(order.price) * from_fixed_point(order.amount);
+        }
+    });
+    return notional;
+}
+
+std::unordered_map<std::string, double> OrderManager::get_open_notional_by_symbol() const {
+    // Accumulate by instrument id and resolve names once at the end
+    std::vector<double> by_instrument;
+    for (OrderStatus status : {OrderStatus::Pending, OrderStatus::Open, OrderStatus::Untriggered}) {
+        for_each_order_by_status(status, [&by_instrument](const Order& order) {
+            if (order.instrument_id >= by_instrument.size()) {
+                by_instrument.resize(order.instrument_id + 1, 0.0);
+            }
+            by_instrument[order.instrument_id] += from_fixed_point(order.price) * from_fixed_point(order.amount);
+        });
+    }
+
+    std::unordered_map<std::string, double> notional;
+    for (uint32_t instrument_id = 0; instrument_id < by_instrument.size(); ++instrument_id) {
+        if (by_instrument[instrument_id] != 0.0) {
+            notional[m_instruments.name(instrument_id)] = by_instrument[instrument_id];
         }
     }
-    return orders;
-}
\ No newline at end of file
+    return notional;
+}
@@ -1,30 +1,245 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <string>
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
+#include <unordered_set>
+#include "instrumentation.h"
+#include "order.h"
+#include "order_journal.h"
 
-struct Order {
-    std::string order_id;
-    std::string symbol;
-    std::string side;
-    double price;
-    double amount;
-    std::string status;
-    std::string timestamp;
+struct OrderParams;
+
+// Exchange answer to an order request
+struct OrderAck {
+    bool success = false;
+    // Response body, or a description of the failure
+    std::string response;
+};
+
+using OrderCallback = std::function<void(const OrderAck&)>;
+
+// Completion handle for an asynchronous order. Sending never blocks on it:
+// poll ready() from the strategy loop, or wait where blocking is acceptable
+// (never on the HTTP client's event loop, which delivers the ack).
+class PendingOrder {
+public:
+    bool ready() const { return m_ready.load(std::memory_order_acquire); }
+    // Only valid once ready()
+    const OrderAck& ack() const { return m_ack; }
+    void wait() const;
+    // False if the ack has not arrived within timeout
+    bool wait_for(std::chrono::milliseconds timeout) const;
+
+    // Called once, by whoever receives the ack
+    void complete(const OrderAck& ack);
+
+private:
+    OrderAck m_ack;
+    std::atomic<bool> m_ready{false};
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_cv;
 };
 
 class OrderManager {
 private:
-    std::unordered_map<std::string, Order> m_orders;
-    std::mutex m_orders_mutex;
+    // Orders are sharded by instrument id modulo the shard count, each
+    // shard behind its own reader-writer lock: queries share it, and
+    // changing one instrument's orders never blocks readers of instruments
+    // in other shards. Instruments that share a shard do contend, so when
+    // every instrument must have its own lock, give the constructor at
+    // least as many shards as instruments will be interned (ids are dense).
+    struct OrderShard {
+        mutable std::shared_timed_mutex mutex;
+        std::unordered_map<OrderId, Order> orders;
+        // Secondary indexes over orders, updated with every change so
+        // queries cost the size of their result. Map nodes never move, so
+        // entries point straight at them. Instruments are indexed by
+        // local_index(instrument_id).
+        std::vector<std::unordered_set<const Order*>> by_instrument;
+        std::array<std::unordered_set<const Order*>, ORDER_STATUS_COUNT> by_status;
+
+        // mutex held exclusively
+        void index(const Order& order, size_t local_id);
+        void unindex(const Order& order, size_t local_id);
+    };
+
+    // Instrument of every order, so lookups by id lock a single order shard.
+    // Sharded by order id; a routing lock is only held for the map access
+    // and never while waiting for an order shard's lock.
+    struct RoutingShard {
+        mutable std::shared_timed_mutex mutex;
+        std::unordered_map<OrderId, uint32_t> instruments;
+    };
+
+    // Sized once by the constructor; never resized, so shards stay put
+    std::vector<OrderShard> m_shards;
+    std::vector<RoutingShard> m_routes;
+    InstrumentRegistry m_instruments;
+    OrderManagerInstrumentation m_instrumentation;
+    // Every change is journaled under the shard lock that orders it, so
+    // replay sees each order's changes in the order they were applied
+    std::unique_ptr<OrderJournal> m_journal;
+
+    OrderShard& shard_for(uint32_t instrument_id) { return m_shards[instrument_id % m_shards.size()]; }
+    const OrderShard& shard_for(uint32_t instrument_id) const { return m_shards[instrument_id % m_shards.size()]; }
+    // Position of the instrument within its shard's by_instrument index
+    size_t local_index(uint32_t instrument_id) const { return instrument_id / m_shards.size(); }
+    RoutingShard& route_for(const OrderId& order_id) { return m_routes[std::hash<OrderId>()(order_id) % m_routes.size()]; }
+    const RoutingShard& route_for(const OrderId& order_id) const {
+        return m_routes[std::hash<OrderId>()(order_id) % m_routes.size()];
+    }
+    // False if the order has no route
+    bool find_route(const OrderId& order_id, uint32_t& instrument_id) const;
+    // Whether the order is currently routed to shard; called with that
+    // shard's lock held to settle races between adds and removes of one id
+    bool routed_to(const OrderId& order_id, const OrderShard& shard) const;
+    void added_record(const Order& order, std::string& payload) const;
+    bool journal_added(const Order& order);
+    bool journal_status(const OrderId& order_id, OrderStatus status);
+    bool journal_removed(const OrderId& order_id);
+    void apply_journal_record(uint8_t type, const char* payload, uint32_t size);
 
 public:
-    void add_order(const Order& order);
-    void update_order_status(const std::string& order_id, const std::string& status);
-    void remove_order(const std::string& order_id);
-    Order get_order(const std::string& order_id) const;
+    static const size_t DEFAULT_SHARD_COUNT = 16;
+
+    // shard_count sets both the order shards and the routing shards; 0 is
+    // treated as 1
+    explicit OrderManager(size_t shard_count = DEFAULT_SHARD_COUNT);
+
+    // Sends an order and returns at once. on_ack runs on the HTTP client's
+    // event loop when the exchange answers, or on the calling thread if the
+    // request cannot be sent; it must not block.
+    void PlaceOrderAsync(const OrderParams& params, const std::string& side, OrderCallback on_ack) const;
+    std::shared_ptr<PendingOrder> PlaceOrderAsync(const OrderParams& params, const std::string& side) const;
+    // Blocking convenience wrapper; one order in flight per calling thread
+    bool PlaceOrder(const OrderParams& params, const std::string& side, std::string& response) const;
+
+    // One instrument's orders, read in place. Holds the shard's read lock
+    // until destroyed, so keep it short-lived and do not modify orders of
+    // the same shard while it exists.
+    class OrdersView {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Order;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Order*;
+            using reference = const Order&;
+
+            explicit iterator(std::unordered_set<const Order*>::const_iterator it) : m_it(it) {}
+            const Order& operator*() const { return **m_it; }
+            const Order* operator->() const { return *m_it; }
+            iterator& operator++() {
+                ++m_it;
+                return *this;
+            }
+            bool operator==(const iterator& other) const { return m_it == other.m_it; }
+            bool operator!=(const iterator& other) const { return m_it != other.m_it; }
+
+        private:
+            std::unordered_set<const Order*>::const_iterator m_it;
+        };
+
+        iterator begin() const { return iterator(m_orders->begin()); }
+        iterator end() const { return iterator(m_orders->end()); }
+        size_t size() const { return m_orders->size(); }
+        bool empty() const { return m_orders->empty(); }
+
+    private:
+        friend class OrderManager;
+        OrdersView(std::shared_lock<std::shared_timed_mutex> lock, const std::unordered_set<const Order*>& orders)
+            : m_lock(std::move(lock)), m_orders(&orders) {}
+
+        std::shared_lock<std::shared_timed_mutex> m_lock;
+        const std::unordered_set<const Order*>* m_orders;
+    };
+
+    void set_performance_monitor(PerformanceMonitor& monitor) { m_instrumentation.attach(monitor); }
+
+    // Conversion at the API boundary; to_order fails if any field does not parse
+    bool to_order(const OrderDetails& details, Order& order);
+    OrderDetails to_details(const Order& order) const;
+    const InstrumentRegistry& instruments() const { return m_instruments; }
+
+    // Restores the orders journaled in directory, then journals every change
+    // there from now on. Call once at startup, before other threads use the
+    // manager; false if recovery or the journal fails, and always where
+    // ORDER_JOURNAL_SUPPORTED is 0.
+    bool open_journal(const std::string& directory);
+    // Snapshots all orders so recovery can skip the journal before it
+    bool write_snapshot();
+    // Commits what is pending and stops journaling; false if any change
+    // since open_journal could not be made durable
+    bool close_journal();
+    // False once the journal has failed to write a change: orders still
+    // change in memory, but later changes will not survive a restart
+    bool journal_healthy() const;
+
+    // Changes return false if the order is invalid or, with a journal open,
+    // the change could not be journaled (it still applies in memory)
+    bool add_order(const Order& order);
+    bool add_order(const OrderDetails& details);
+    bool update_order_status(const OrderId& order_id, OrderStatus status);
+    bool remove_order(const OrderId& order_id);
+    // False if no such order
+    bool get_order(const OrderId& order_id, Order& order) const;
+    // Queries spanning shards lock them one at a time, so they are not an
+    // atomic view of orders changing meanwhile
     std::vector<Order> get_all_orders() const;
     std::vector<Order> get_orders_by_symbol(const std::string& symbol) const;
-    std::vector<Order> get_orders_by_status(const std::string& status) const;
-};
\ No newline at end of file
+    std::vector<Order> get_orders_by_status(OrderStatus status) const;
+
+    // In-place queries: visitor(const Order&) runs under each shard's read
+    // lock and must not modify orders
+    template <typename Visitor>
+    void for_each_order(Visitor&& visitor) const {
+        for (const OrderShard& shard : m_shards) {
+            std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+            for (const auto& pair : shard.orders) {
+                visitor(pair.second);
+            }
+        }
+    }
+
+    template <typename Visitor>
+    void for_each_order_by_symbol(const std::string& symbol, Visitor&& visitor) const {
+        for (const Order& order : view_orders_by_symbol(symbol)) {
+            visitor(order);
+        }
+    }
+
+    template <typename Visitor>
+    void for_each_order_by_status(OrderStatus status, Visitor&& visitor) const {
+        if (status >= OrderStatus::Count) {
+            return;
+        }
+        for (const OrderShard& shard : m_shards) {
+            std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+            for (const Order* order : shard.by_status[static_cast<size_t>(status)]) {
+                visitor(*order);
+            }
+        }
+    }
+
+    OrdersView view_orders_by_symbol(const std::string& symbol) const;
+
+    // Aggregates computed without copying orders
+    size_t count_orders() const;
+    size_t count_orders_by_symbol(const std::string& symbol) const;
+    size_t count_orders_by_status(OrderStatus status) const;
+    // Sum of price * amount over working orders (pending, open, untriggered)
+    double get_open_notional(const std::string& symbol) const;
+    // Symbols without working orders are left out
+    std::unordered_map<std::string, double> get_open_notional_by_symbol() const;
+};
@@ -5,170 +5,948 @@
 #include <cmath>
 #include <sstream>
 #include <iomanip>
+#include <fstream>
 
-PerformanceMonitor::PerformanceMonitor() : m_start_time(std::chrono::steady_clock::now()) {}
+namespace {
+double to_us(double ns) {
+    return ns / 1000.0;
+}
 
-void PerformanceMonitor::record_latency(const std::string& operation, uint64_t latency_us) {
+const size_t THREAD_RING_CAPACITY = 16384;
+const std::chrono::milliseconds AGGREGATION_INTERVAL(5);
+// Trailing windows reported alongside the lifetime statistics
+const std::pair<const char*, std::chrono::seconds> REPORTED_WINDOWS[] = {
+    {"1s", std::chrono::seconds(1)},
+    {"10s", std::chrono::seconds(10)},
+    {"60s", std::chrono::seconds(60)},
+    {"5m", std::chrono::seconds(300)},
+};
+// Upper bounds of the cumulative latency buckets in snapshots, in nanoseconds
+const uint64_t LATENCY_BUCKETS_NS[] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000,
+    250000000, 500000000, 1000000000,
+};
+// Most recent outliers kept
+const size_t OUTLIER_CAPACITY = 1024;
+
+// Label values escape backslash, double quote and newline
+std::string openmetrics_label(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+const uint32_t NO_TRACE_TRIGGER = UINT32_MAX;
+const std::chrono::seconds TRACE_TRIGGER_MIN_INTERVAL(1);
+// Power of two; bounds the number of tick-to-trade traces in flight
+const size_t TRACE_SLOTS = 4096;
+
+std::atomic<uint64_t> g_next_monitor_id{1};
+
+// Indexed by BuiltinMetric
+const char* const BUILTIN_METRIC_NAMES[] = {
+    "websocket_broadcast",
+    "subscription_handling",
+    "websocket_message_processing",
+    "tick_to_trade.parse",
+    "tick_to_trade.book_update",
+    "tick_to_trade.strategy",
+    "tick_to_trade.order_send",
+    "tick_to_trade.ack",
+    "tick_to_trade.total",
+    "order_placement",
+    "api_request",
+};
+static_assert(sizeof(BUILTIN_METRIC_NAMES) / sizeof(BUILTIN_METRIC_NAMES[0]) ==
+              static_cast<size_t>(BuiltinMetric::Count), "every builtin metric needs a name");
+}
+
+PerformanceMonitor::PerformanceMonitor(uint64_t highest_trackable_ns, int significant_digits)
+    : m_id(g_next_monitor_id++),
+      m_highest_trackable_ns(highest_trackable_ns),
+      m_significant_digits(significant_digits),
+      m_start_time(std::chrono::steady_clock::now()),
+      m_traces(new TraceSlot[TRACE_SLOTS]),
+      m_trigger_metric(NO_TRACE_TRIGGER) {
+    TscClock::calibrate();
+    for (const char* name : BUILTIN_METRIC_NAMES) {
+        register_metric(name);
+    }
+    m_aggregator = std::thread(&PerformanceMonitor::aggregator_loop, this);
+}
+
+PerformanceMonitor::~PerformanceMonitor() {
+    {
+        std::lock_guard<std::mutex> lock(m_aggregator_mutex);
+        m_stopping = true;
+    }
+    m_aggregator_cv.notify_one();
+    m_aggregator.join();
+}
+
+PerformanceMonitor::ThreadBuffer& PerformanceMonitor::thread_buffer() {
+    // Marks the thread's buffers retired on thread exit so the aggregator can
+    // release them once drained
+    struct Registry {
+        std::unordered_map<uint64_t, std::shared_ptr<ThreadBuffer>> buffers;
+        ~Registry() {
+            for (auto& entry : buffers) {
+                entry.second->retired.store(true, std::memory_order_release);
+            }
+        }
+    };
+    thread_local Registry registry;
+    thread_local uint64_t cached_monitor = 0;
+    thread_local ThreadBuffer* cached_buffer = nullptr;
+
+    if (cached_monitor == m_id) {
+        return *cached_buffer;
+    }
+    auto& buffer = registry.buffers[m_id];
+    if (!buffer) {
+        buffer = std::make_shared<ThreadBuffer>(THREAD_RING_CAPACITY, m_next_thread_id++);
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        m_thread_buffers.push_back(buffer);
+    }
+    cached_monitor = m_id;
+    cached_buffer = buffer.get();
+    return *buffer;
+}
+
+MetricHandle PerformanceMonitor::register_metric(const std::string& operation) {
     std::lock_guard<std::mutex> lock(m_metrics_mutex);
-    auto& metrics = m_metrics[operation];
-    
-    metrics.total_count++;
-    metrics.total_latency += latency_us;
-    
-    uint64_t current_min = metrics.min_latency.load();
-    while (latency_us < current_min && 
-           !metrics.min_latency.compare_exchange_weak(current_min, latency_us)) {}
-    
-    uint64_t current_max = metrics.max_latency.load();
-    while (latency_us > current_max && 
-           !metrics.max_latency.compare_exchange_weak(current_max, latency_us)) {}
-    
+    auto it = m_metric_ids.find(operation);
+    if (it != m_metric_ids.end()) {
+        return MetricHandle{it->second};
+    }
+    const uint32_t id = static_cast<uint32_t>(m_metrics.size());
+    m_metrics.emplace_back(m_highest_trackable_ns, m_significant_digits);
+    m_metric_ids.emplace(operation, id);
+    return MetricHandle{id};
+}
+
+void PerformanceMonitor::record_latency_ns(MetricHandle metric, uint64_t latency_ns) {
+    record_sample_ns(metric, latency_ns, nullptr);
+}
+
+void PerformanceMonitor::record_sample_ns(MetricHandle metric, uint64_t latency_ns, const SampleContext* context) {
+    ThreadBuffer& buffer = thread_buffer();
+    if (!buffer.ring.push(metric.index, latency_ns)) {
+        // Ring full: the aggregator is behind, so record directly
+        m_ring_overflows.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_metrics_mutex);
+        record_sample(m_metrics[metric.index], latency_ns, now_ns());
+    }
+
+    if (m_outlier_version.load(std::memory_order_acquire) != buffer.outlier_version) {
+        refresh_outlier_thresholds(buffer);
+    }
+    if (metric.index < buffer.outlier_thresholds.size() && latency_ns > buffer.outlier_thresholds[metric.index]) {
+        capture_outlier(buffer, metric.index, latency_ns, context);
+    }
+}
+
+void PerformanceMonitor::refresh_outlier_thresholds(ThreadBuffer& buffer) {
+    std::lock_guard<std::mutex> lock(m_outlier_mutex);
+    buffer.outlier_thresholds = m_outlier_thresholds;
+    buffer.outlier_version = m_outlier_version.load(std::memory_order_relaxed);
+}
+
+void PerformanceMonitor::capture_outlier(const ThreadBuffer& buffer, uint32_t metric, uint64_t latency_ns,
+                                         const SampleContext* context) {
+    Outlier outlier;
+    outlier.metric = metric;
+    outlier.thread_id = buffer.thread_id;
+    outlier.latency_ns = latency_ns;
+    outlier.timestamp_ns = now_ns();
+    outlier.wall_clock_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    if (context) {
+        outlier.context = *context;
+    }
+
+    std::lock_guard<std::mutex> lock(m_outlier_mutex);
+    if (m_outliers.size() < OUTLIER_CAPACITY) {
+        m_outliers.push_back(outlier);
+    } else {
+        m_outliers[m_outlier_count % OUTLIER_CAPACITY] = outlier;
+    }
+    ++m_outlier_count;
+}
+
+// Windows are bucketed by aggregation time, which trails the measurement by
+// at most one aggregation interval
+void PerformanceMonitor::record_sample(Metrics& metrics, uint64_t latency_ns, uint64_t now) const {
+    metrics.latency_histogram.record(latency_ns);
+    metrics.recent.record(latency_ns, now);
+}
+
+uint32_t PerformanceMonitor::thread_metric_id(ThreadBuffer& buffer, const std::string& operation) {
+    auto it = buffer.metric_ids.find(operation);
+    if (it == buffer.metric_ids.end()) {
+        it = buffer.metric_ids.emplace(operation, register_metric(operation).index).first;
+    }
+    return it->second;
+}
+
+void PerformanceMonitor::record_latency(const std::string& operation, uint64_t latency_us) {
+    record_latency_ns(MetricHandle{thread_metric_id(thread_buffer(), operation)}, latency_us * 1000);
+}
+
+void PerformanceMonitor::flush() const {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
     {
-        std::lock_guard<std::mutex> samples_lock(metrics.samples_mutex);
-        metrics.latency_samples.push_back(latency_us);
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        buffers = m_thread_buffers;
+    }
+
+    bool any_retired = false;
+    {
+        std::lock_guard<std::mutex> lock(m_metrics_mutex);
+        const uint64_t now = now_ns();
+        for (const auto& buffer : buffers) {
+            // Read the flag before draining so nothing pushed before retirement is lost
+            const bool retired = buffer->retired.load(std::memory_order_acquire);
+            buffer->ring.drain([this, now](const SampleRing::Sample& sample) {
+                record_sample(m_metrics[sample.metric], sample.value, now);
+            });
+            any_retired = any_retired || retired;
+        }
+    }
+
+    if (any_retired) {
+        std::vector<std::shared_ptr<ThreadBuffer>> released;
+        {
+            std::lock_guard<std::mutex> lock(m_buffers_mutex);
+            auto retired_begin = std::partition(m_thread_buffers.begin(), m_thread_buffers.end(),
+                [](const std::shared_ptr<ThreadBuffer>& buffer) {
+                    return !(buffer->retired.load(std::memory_order_acquire) && buffer->ring.empty());
+                });
+            released.assign(retired_begin, m_thread_buffers.end());
+            m_thread_buffers.erase(retired_begin, m_thread_buffers.end());
+        }
+        // Keep the allocation stats of exited threads
+        std::lock_guard<std::mutex> lock(m_metrics_mutex);
+        for (const auto& buffer : released) {
+            for (size_t i = 0; i < buffer->allocations.size(); ++i) {
+                m_metrics[i].retired_allocations.merge(buffer->allocations[i].load());
+            }
+        }
+    }
+}
+
+void PerformanceMonitor::aggregator_loop() {
+    std::unique_lock<std::mutex> lock(m_aggregator_mutex);
+    while (!m_stopping) {
+        m_aggregator_cv.wait_for(lock, AGGREGATION_INTERVAL);
+        lock.unlock();
+        flush();
+        if (m_trigger_fired.exchange(false, std::memory_order_acq_rel)) {
+            dump_triggered_trace();
+        }
+        lock.lock();
+    }
+}
+
+void PerformanceMonitor::start_operation(MetricHandle metric) {
+    auto& spans = thread_buffer().open_spans;
+    spans.push_back(OpenSpan{metric.index, 0, AllocationCounters{0, 0}});
+    spans.back().allocations = AllocationTracker::thread_counters();
+    spans.back().start_ns = now_ns();
+}
+
+void PerformanceMonitor::end_operation(MetricHandle metric) {
+    const uint64_t end_ns = now_ns();
+    const AllocationCounters end_allocations = AllocationTracker::thread_counters();
+    auto& spans = thread_buffer().open_spans;
+    // Innermost open span for this metric; unmatched ends are ignored
+    for (auto it = spans.rbegin(); it != spans.rend(); ++it) {
+        if (it->metric == metric.index) {
+            const OpenSpan span = *it;
+            spans.erase(std::next(it).base());
+            record_span(metric, span.start_ns, end_ns);
+            if (AllocationTracker::enabled) {
+                record_allocations(metric, end_allocations - span.allocations);
+            }
+            return;
+        }
+    }
+}
+
+void PerformanceMonitor::record_allocations(MetricHandle metric, const AllocationCounters& allocated) {
+    ThreadBuffer& buffer = thread_buffer();
+    if (metric.index >= buffer.allocations.size()) {
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        while (buffer.allocations.size() <= metric.index) {
+            buffer.allocations.emplace_back();
+        }
+    }
+    buffer.allocations[metric.index].add(allocated);
+}
+
+void PerformanceMonitor::record_span(MetricHandle metric, uint64_t start_ns, uint64_t end_ns,
+                                     const SampleContext* context) {
+    if (m_trace_capacity.load(std::memory_order_relaxed) != 0) {
+        trace_span(thread_buffer(), metric.index, start_ns, end_ns - start_ns);
+    }
+    record_sample_ns(metric, end_ns - start_ns, context);
+}
+
+void PerformanceMonitor::trace_span(ThreadBuffer& buffer, uint32_t metric, uint64_t start_ns, uint64_t duration_ns) {
+    if (!buffer.spans) {
+        auto spans = std::make_shared<SpanRing>(m_trace_capacity.load(std::memory_order_relaxed));
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        buffer.spans = std::move(spans);
+    }
+    buffer.spans->record(metric, start_ns, duration_ns);
+
+    if (metric == m_trigger_metric.load(std::memory_order_relaxed) &&
+        duration_ns > m_trigger_threshold_ns.load(std::memory_order_relaxed)) {
+        m_trigger_fired.store(true, std::memory_order_release);
     }
 }
 
 void PerformanceMonitor::start_operation(const std::string& operation) {
-    // Implementation for tracking operation start time
-    // This would be used for more detailed timing analysis
+    start_operation(MetricHandle{thread_metric_id(thread_buffer(), operation)});
 }
 
 void PerformanceMonitor::end_operation(const std::string& operation) {
-    // Implementation for tracking operation end time
-    // This would be used for more detailed timing analysis
+    end_operation(MetricHandle{thread_metric_id(thread_buffer(), operation)});
+}
+
+uint64_t PerformanceMonitor::begin_trace() {
+    const uint64_t correlation_id = m_next_correlation_id.fetch_add(1, std::memory_order_relaxed);
+    const uint64_t now = now_ns();
+    TraceSlot& slot = m_traces[correlation_id & (TRACE_SLOTS - 1)];
+    slot.origin_ns.store(now, std::memory_order_relaxed);
+    slot.last_ns.store(now, std::memory_order_relaxed);
+    slot.correlation_id.store(correlation_id, std::memory_order_release);
+    return correlation_id;
+}
+
+void PerformanceMonitor::mark_stage(uint64_t correlation_id, TradeStage stage) {
+    if (stage == TradeStage::Receive) {
+        return;
+    }
+    TraceSlot& slot = m_traces[correlation_id & (TRACE_SLOTS - 1)];
+    if (slot.correlation_id.load(std::memory_order_acquire) != correlation_id) {
+        return;  // Unknown or overwritten by a newer trace
+    }
+    const uint64_t now = now_ns();
+    const uint64_t previous = slot.last_ns.exchange(now, std::memory_order_acq_rel);
+    // Stage metrics follow WebSocketMessageProcessing in BuiltinMetric, Parse first
+    const uint32_t stage_metric = static_cast<uint32_t>(BuiltinMetric::TickToTradeParse) +
+                                  static_cast<uint32_t>(stage) - static_cast<uint32_t>(TradeStage::Parse);
+    record_span(MetricHandle{stage_metric}, previous, now);
+
+    if (stage == TradeStage::Ack) {
+        record_span(builtin_handle(BuiltinMetric::TickToTradeTotal), slot.origin_ns.load(std::memory_order_relaxed), now);
+        uint64_t expected = correlation_id;
+        slot.correlation_id.compare_exchange_strong(expected, 0, std::memory_order_acq_rel);
+    }
+}
+
+void PerformanceMonitor::enable_tracing(size_t spans_per_thread) {
+    m_trace_capacity.store(std::max<size_t>(spans_per_thread, 1), std::memory_order_relaxed);
+}
+
+// Recorded spans stay in the rings so they can still be dumped
+void PerformanceMonitor::disable_tracing() {
+    m_trace_capacity.store(0, std::memory_order_relaxed);
+}
+
+void PerformanceMonitor::set_thread_name(const std::string& name) {
+    ThreadBuffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+    buffer.thread_name = name;
+}
+
+std::string PerformanceMonitor::get_trace_json() const {
+    struct TracedThread {
+        uint32_t thread_id;
+        std::string name;
+        std::shared_ptr<SpanRing> spans;
+    };
+    std::vector<TracedThread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        for (const auto& buffer : m_thread_buffers) {
+            if (buffer->spans) {
+                threads.push_back({buffer->thread_id, buffer->thread_name, buffer->spans});
+            }
+        }
+    }
+    std::vector<std::string> metric_names;
+    {
+        std::lock_guard<std::mutex> lock(m_metrics_mutex);
+        metric_names.resize(m_metrics.size());
+        for (const auto& pair : m_metric_ids) {
+            metric_names[pair.second] = pair.first;
+        }
+    }
+
+    // Complete ("X") events with microsecond timestamps, one tid per thread
+    Json::Value events(Json::arrayValue);
+    for (const auto& thread : threads) {
+        Json::Value name_event;
+        name_event["name"] = "thread_name";
+        name_event["ph"] = "M";
+        name_event["pid"] = 1;
+        name_event["tid"] = thread.thread_id;
+        name_event["args"]["name"] = thread.name.empty() ? "thread-" + std::to_string(thread.thread_id) : thread.name;
+        events.append(name_event);
+
+        thread.spans->for_each([&](const SpanRing::Span& span) {
+            Json::Value event;
+            event["name"] = span.metric < metric_names.size() ? metric_names[span.metric] : "unknown";
+            event["cat"] = "span";
+            event["ph"] = "X";
+            event["ts"] = span.start_ns / 1000.0;
+            event["dur"] = span.duration_ns / 1000.0;
+            event["pid"] = 1;
+            event["tid"] = thread.thread_id;
+            events.append(event);
+        });
+    }
+
+    Json::Value root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ns";
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    // Nanosecond resolution on microsecond timestamps
+    writer["precisionType"] = "decimal";
+    writer["precision"] = 3;
+    return Json::writeString(writer, root);
+}
+
+bool PerformanceMonitor::dump_trace(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << get_trace_json();
+    return true;
+}
+
+void PerformanceMonitor::set_trace_trigger(MetricHandle metric, uint64_t threshold_ns,
+                                           const std::string& filename_prefix) {
+    {
+        std::lock_guard<std::mutex> lock(m_trigger_mutex);
+        m_trigger_prefix = filename_prefix;
+    }
+    m_trigger_threshold_ns.store(threshold_ns, std::memory_order_relaxed);
+    m_trigger_metric.store(metric.index, std::memory_order_relaxed);
+}
+
+void PerformanceMonitor::clear_trace_trigger() {
+    m_trigger_metric.store(NO_TRACE_TRIGGER, std::memory_order_relaxed);
+}
+
+void PerformanceMonitor::dump_triggered_trace() {
+    std::string filename;
+    {
+        std::lock_guard<std::mutex> lock(m_trigger_mutex);
+        const auto now = std::chrono::steady_clock::now();
+        if (m_trigger_dumps > 0 && now - m_last_trigger_dump < TRACE_TRIGGER_MIN_INTERVAL) {
+            return;
+        }
+        m_last_trigger_dump = now;
+        filename = m_trigger_prefix + "." + std::to_string(m_trigger_dumps++) + ".json";
+    }
+    if (!dump_trace(filename)) {
+        std::cerr << "Failed to write trace dump " << filename << std::endl;
+    }
+}
+
+void PerformanceMonitor::set_outlier_threshold(MetricHandle metric, uint64_t threshold_ns) {
+    std::lock_guard<std::mutex> lock(m_outlier_mutex);
+    if (metric.index >= m_outlier_thresholds.size()) {
+        m_outlier_thresholds.resize(metric.index + 1, UINT64_MAX);
+    }
+    m_outlier_thresholds[metric.index] = threshold_ns;
+    m_outlier_version.fetch_add(1, std::memory_order_release);
+}
+
+void PerformanceMonitor::clear_outlier_threshold(MetricHandle metric) {
+    std::lock_guard<std::mutex> lock(m_outlier_mutex);
+    if (metric.index < m_outlier_thresholds.size()) {
+        m_outlier_thresholds[metric.index] = UINT64_MAX;
+        m_outlier_version.fetch_add(1, std::memory_order_release);
+    }
+}
+
+std::vector<OutlierRecord> PerformanceMonitor::get_outliers() const {
+    std::vector<Outlier> outliers;
+    {
+        std::lock_guard<std::mutex> lock(m_outlier_mutex);
+        // Unroll the ring so the oldest comes first
+        const size_t oldest = m_outliers.size() < OUTLIER_CAPACITY ? 0 : m_outlier_count % OUTLIER_CAPACITY;
+        outliers.reserve(m_outliers.size());
+        outliers.insert(outliers.end(), m_outliers.begin() + oldest, m_outliers.end());
+        outliers.insert(outliers.end(), m_outliers.begin(), m_outliers.begin() + oldest);
+    }
+    std::vector<std::string> metric_names;
+    {
+        std::lock_guard<std::mutex> lock(m_metrics_mutex);
+        metric_names.resize(m_metrics.size());
+        for (const auto& pair : m_metric_ids) {
+            metric_names[pair.second] = pair.first;
+        }
+    }
+
+    std::vector<OutlierRecord> records;
+    records.reserve(outliers.size());
+    for (const auto& outlier : outliers) {
+        OutlierRecord record;
+        record.operation = outlier.metric < metric_names.size() ? metric_names[outlier.metric] : "unknown";
+        record.instrument = outlier.context.instrument;
+        record.latency_ns = outlier.latency_ns;
+        record.timestamp_ns = outlier.timestamp_ns;
+        record.wall_clock_ns = outlier.wall_clock_ns;
+        record.thread_id = outlier.thread_id;
+        record.queue_depth = outlier.context.queue_depth;
+        record.message_size = outlier.context.message_size;
+        records.push_back(std::move(record));
+    }
+    return records;
+}
+
+std::string PerformanceMonitor::get_outliers_json() const {
+    Json::Value outliers(Json::arrayValue);
+    for (const auto& record : get_outliers()) {
+        Json::Value outlier;
+        outlier["operation"] = record.operation;
+        outlier["latency_us"] = to_us(static_cast<double>(record.latency_ns));
+        outlier["timestamp_ns"] = Json::UInt64(record.timestamp_ns);
+        outlier["wall_clock_ns"] = Json::UInt64(record.wall_clock_ns);
+        outlier["thread_id"] = record.thread_id;
+        outlier["instrument"] = record.instrument;
+        outlier["queue_depth"] = record.queue_depth;
+        outlier["message_size"] = record.message_size;
+        outliers.append(outlier);
+    }
+
+    Json::Value root;
+    root["outliers"] = outliers;
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "  ";
+    return Json::writeString(writer, root);
+}
+
+bool PerformanceMonitor::dump_outliers(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << get_outliers_json();
+    return true;
+}
+
+void PerformanceMonitor::clear_outliers() {
+    std::lock_guard<std::mutex> lock(m_outlier_mutex);
+    m_outliers.clear();
+    m_outlier_count = 0;
+}
+
+const PerformanceMonitor::Metrics* PerformanceMonitor::find_metrics(const std::string& operation) const {
+    auto it = m_metric_ids.find(operation);
+    return it != m_metric_ids.end() ? &m_metrics[it->second] : nullptr;
 }
 
 double PerformanceMonitor::get_average_latency(const std::string& operation) const {
+    flush();
     std::lock_guard<std::mutex> lock(m_metrics_mutex);
-    auto it = m_metrics.find(operation);
-    if (it != m_metrics.end() && it->second.total_count > 0) {
-        return static_cast<double>(it->second.total_latency) / it->second.total_count;
-    }
-    return 0.0;
+    const Metrics* metrics = find_metrics(operation);
+    return metrics ? to_us(metrics->latency_histogram.mean()) : 0.0;
 }
 
 uint64_t PerformanceMonitor::get_min_latency(const std::string& operation) const {
+    flush();
     std::lock_guard<std::mutex> lock(m_metrics_mutex);
-    auto it = m_metrics.find(operation);
-    if (it != m_metrics.end()) {
-        return it->second.min_latency;
-    }
-    return 0;
+    const Metrics* metrics = find_metrics(operation);
+    return metrics ? metrics->latency_histogram.min() / 1000 : 0;
 }
 
 uint64_t PerformanceMonitor::get_max_latency(const std::string& operation) const {
+    flush();
     std::lock_guard<std::mutex> lock(m_metrics_mutex);
-    auto it = m_metrics.find(operation);
-    if (it != m_metrics.end()) {
-        return it->second.max_latency;
-    }
-    return 0;
+    const Metrics* metrics = find_metrics(operation);
+    return metrics ? metrics->latency_histogram.max() / 1000 : 0;
 }
 
 uint64_t PerformanceMonitor::get_total_operations(const std::string& operation) const {
+    flush();
     std::lock_guard<std::mutex> lock(m_metrics_mutex);
-    auto it = m_metrics.find(operation);
-    if (it != m_metrics.end()) {
-        return it->second.total_count;
+    const Metrics* metrics = find_metrics(operation);
+    return metrics ? metrics->latency_histogram.total_count() : 0;
+}
+
+double PerformanceMonitor::operations_per_second(const Metrics& metrics) const {
+    auto now = std::chrono::steady_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - m_start_time).count();
+    if (duration > 0) {
+        return static_cast<double>(metrics.latency_histogram.total_count()) / duration;
     }
-    return 0;
+    return 0.0;
 }
 
 double PerformanceMonitor::get_operations_per_second(const std::string& operation) const {
+    flush();
     std::lock_guard<std::mutex> lock(m_metrics_mutex);
-    auto it = m_metrics.find(operation);
-    if (it != m_metrics.end()) {
-        auto now = std::chrono::steady_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - m_start_time).count();
-        if (duration > 0) {
-            return static_cast<double>(it->second.total_count) / duration;
-        }
-    }
-    return 0.0;
+    const Metrics* metrics = find_metrics(operation);
+    return metrics ? operations_per_second(*metrics) : 0.0;
 }
 
 double PerformanceMonitor::get_latency_percentile(const std::string& operation, double percentile) const {
+    flush();
     std::lock_guard<std::mutex> lock(m_metrics_mutex);
-    auto it = m_metrics.find(operation);
-    if (it != m_metrics.end()) {
-        std::lock_guard<std::mutex> samples_lock(it->second.samples_mutex);
-        auto& samples = it->second.latency_samples;
-        if (!samples.empty()) {
-            std::vector<uint64_t> sorted_samples = samples;
-            std::sort(sorted_samples.begin(), sorted_samples.end());
-            size_t index = static_cast<size_t>(percentile * (sorted_samples.size() - 1));
-            return static_cast<double>(sorted_samples[index]);
+    const Metrics* metrics = find_metrics(operation);
+    return metrics ? to_us(metrics->latency_histogram.value_at_percentile(percentile * 100.0)) : 0.0;
+}
+
+double PerformanceMonitor::get_latency_standard_deviation(const std::string& operation) const {
+    flush();
+    std::lock_guard<std::mutex> lock(m_metrics_mutex);
+    const Metrics* metrics = find_metrics(operation);
+    return metrics ? to_us(metrics->latency_histogram.standard_deviation()) : 0.0;
+}
+
+double PerformanceMonitor::get_operations_per_second(const std::string& operation,
+                                                     std::chrono::seconds window) const {
+    flush();
+    std::lock_guard<std::mutex> lock(m_metrics_mutex);
+    const Metrics* metrics = find_metrics(operation);
+    return metrics ? metrics->recent.rate(window, now_ns()) : 0.0;
+}
+
+double PerformanceMonitor::get_latency_percentile(const std::string& operation, double percentile,
+                                                  std::chrono::seconds window) const {
+    flush();
+    std::lock_guard<std::mutex> lock(m_metrics_mutex);
+    const Metrics* metrics = find_metrics(operation);
+    return metrics ? to_us(metrics->recent.window(window, now_ns()).value_at_percentile(percentile * 100.0)) : 0.0;
+}
+
+// Metric ids stay valid because threads cache them, so clearing resets the
+// histograms in place instead of erasing them
+void PerformanceMonitor::clear_metrics(const std::string& operation) {
+    flush();
+    std::lock_guard<std::mutex> lock(m_metrics_mutex);
+    auto it = m_metric_ids.find(operation);
+    if (it != m_metric_ids.end()) {
+        m_metrics[it->second].latency_histogram.reset();
+        m_metrics[it->second].recent.reset();
+        m_metrics[it->second].retired_allocations = AllocationTotals();
+        reset_thread_allocations(it->second);
+    }
+}
+
+void PerformanceMonitor::reset_thread_allocations(uint32_t metric) const {
+    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+    for (const auto& buffer : m_thread_buffers) {
+        if (metric < buffer->allocations.size()) {
+            buffer->allocations[metric].reset();
         }
     }
-    return 0.0;
 }
 
-double PerformanceMonitor::get_latency_standard_deviation(const std::string& operation) const {
+void PerformanceMonitor::clear_all_metrics() {
+    flush();
     std::lock_guard<std::mutex> lock(m_metrics_mutex);
-    auto it = m_metrics.find(operation);
-    if (it != m_metrics.end()) {
-        std::lock_guard<std::mutex> samples_lock(it->second.samples_mutex);
-        auto& samples = it->second.latency_samples;
-        if (!samples.empty()) {
-            double mean = static_cast<double>(it->second.total_latency) / it->second.total_count;
-            double sum_squares = 0.0;
-            for (uint64_t latency : samples) {
-                double diff = static_cast<double>(latency) - mean;
-                sum_squares += diff * diff;
+    for (auto& metrics : m_metrics) {
+        metrics.latency_histogram.reset();
+        metrics.recent.reset();
+        metrics.retired_allocations = AllocationTotals();
+    }
+    for (uint32_t metric = 0; metric < m_metrics.size(); ++metric) {
+        reset_thread_allocations(metric);
+    }
+}
+
+MetricsSnapshot PerformanceMonitor::snapshot() const {
+    // Copy of one operation's state, taken under the lock
+    struct Captured {
+        std::string operation;
+        LatencyHistogram histogram;
+        AllocationTotals allocations;
+        std::vector<double> window_rates;
+        std::vector<LatencyHistogram> window_histograms;
+    };
+    std::vector<Captured> captured;
+    MetricsSnapshot snapshot;
+
+    std::vector<AllocationTotals> allocations;
+
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        snapshot.recording_threads = m_thread_buffers.size();
+        for (const auto& buffer : m_thread_buffers) {
+            if (buffer->allocations.size() > allocations.size()) {
+                allocations.resize(buffer->allocations.size());
+            }
+            for (size_t i = 0; i < buffer->allocations.size(); ++i) {
+                allocations[i].merge(buffer->allocations[i].load());
             }
-            return std::sqrt(sum_squares / samples.size());
         }
     }
-    return 0.0;
+    snapshot.allocations_tracked = AllocationTracker::enabled;
+    std::vector<std::pair<std::string, uint32_t>> metric_ids;
+    uint64_t now;
+    {
+        std::lock_guard<std::mutex> lock(m_metrics_mutex);
+        now = now_ns();
+        snapshot.uptime_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start_time).count();
+        snapshot.ring_overflows = m_ring_overflows.load(std::memory_order_relaxed);
+        metric_ids.assign(m_metric_ids.begin(), m_metric_ids.end());
+    }
+    // The lock is taken per metric: copying one metric's histograms and
+    // merging its window slots is the longest registration or aggregation
+    // waits, however many metrics there are. m_metrics is a deque, so the
+    // entries stay put while metrics are registered in between.
+    captured.reserve(metric_ids.size());
+    for (const auto& pair : metric_ids) {
+        Captured entry{pair.first, LatencyHistogram(1, 1), {}, {}, {}};
+        {
+            std::lock_guard<std::mutex> lock(m_metrics_mutex);
+            const Metrics& metrics = m_metrics[pair.second];
+            if (pair.second >= allocations.size()) {
+                allocations.resize(pair.second + 1);
+            }
+            allocations[pair.second].merge(metrics.retired_allocations);
+            entry.histogram = metrics.latency_histogram;
+            for (const auto& window : REPORTED_WINDOWS) {
+                entry.window_rates.push_back(metrics.recent.rate(window.second, now));
+                entry.window_histograms.push_back(metrics.recent.window(window.second, now));
+            }
+        }
+        entry.allocations = allocations[pair.second];
+        captured.push_back(std::move(entry));
+    }
+
+    static const std::vector<double> percentiles = {50.0, 95.0, 99.0, 99.9, 99.99};
+    static const std::vector<double> window_percentiles = {50.0, 99.0, 99.9};
+    static const std::vector<uint64_t> bucket_bounds(std::begin(LATENCY_BUCKETS_NS), std::end(LATENCY_BUCKETS_NS));
+    const double whole_seconds = std::floor(snapshot.uptime_seconds);
+
+    snapshot.operations.reserve(captured.size());
+    for (const auto& entry : captured) {
+        const LatencyHistogram& histogram = entry.histogram;
+        const std::vector<uint64_t> values = histogram.values_at_percentiles(percentiles);
+        const std::vector<uint64_t> counts = histogram.counts_at_or_below(bucket_bounds);
+
+        MetricsSnapshot::Operation operation;
+        operation.name = entry.operation;
+        operation.total_operations = histogram.total_count();
+        operation.operations_per_second = whole_seconds > 0 ? histogram.total_count() / whole_seconds : 0.0;
+        operation.average_latency = to_us(histogram.mean());
+        operation.min_latency = to_us(histogram.min());
+        operation.max_latency = to_us(histogram.max());
+        operation.p50_latency = to_us(values[0]);
+        operation.p95_latency = to_us(values[1]);
+        operation.p99_latency = to_us(values[2]);
+        operation.p999_latency = to_us(values[3]);
+        operation.p9999_latency = to_us(values[4]);
+        operation.standard_deviation = to_us(histogram.standard_deviation());
+        operation.total_latency = to_us(histogram.total_sum());
+        operation.allocations = entry.allocations;
+        for (size_t i = 0; i < bucket_bounds.size(); ++i) {
+            operation.buckets.push_back({bucket_bounds[i], counts[i]});
+        }
+
+        for (size_t i = 0; i < entry.window_histograms.size(); ++i) {
+            const LatencyHistogram& recent = entry.window_histograms[i];
+            const std::vector<uint64_t> window_values = recent.values_at_percentiles(window_percentiles);
+            MetricsSnapshot::Window window;
+            window.name = REPORTED_WINDOWS[i].first;
+            window.span = REPORTED_WINDOWS[i].second;
+            window.operations_per_second = entry.window_rates[i];
+            window.p50_latency = to_us(window_values[0]);
+            window.p99_latency = to_us(window_values[1]);
+            window.p999_latency = to_us(window_values[2]);
+            window.max_latency = to_us(recent.max());
+            operation.windows.push_back(window);
+        }
+        snapshot.operations.push_back(std::move(operation));
+    }
+    return snapshot;
 }
 
 void PerformanceMonitor::print_metrics() const {
-    std::lock_guard<std::mutex> lock(m_metrics_mutex);
+    const MetricsSnapshot metrics = snapshot();
     std::cout << "\nPerformance Metrics:\n";
     std::cout << "===================\n\n";
-    
-    for (const auto& pair : m_metrics) {
-        const auto& operation = pair.first;
-        std::cout << operation << ":\n";
-        std::cout << "  Total Operations: " << get_total_operations(operation) << "\n";
-        std::cout << "  Operations/sec: " << std::fixed << std::setprecision(2) 
-                  << get_operations_per_second(operation) << "\n";
-        std::cout << "  Average Latency: " << std::fixed << std::setprecision(2) 
-                  << get_average_latency(operation) << " μs\n";
-        std::cout << "  Min Latency: " << get_min_latency(operation) << " μs\n";
-        std::cout << "  Max Latency: " << get_max_latency(operation) << " μs\n";
-        std::cout << "  P50 Latency: " << std::fixed << std::setprecision(2) 
-                  << get_latency_percentile(operation, 0.5) << " μs\n";
-        std::cout << "  P95 Latency: " << std::fixed << std::setprecision(2) 
-                  << get_latency_percentile(operation, 0.95) << " μs\n";
-        std::cout << "  P99 Latency: " << std::fixed << std::setprecision(2) 
-                  << get_latency_percentile(operation, 0.99) << " μs\n";
-        std::cout << "  Std Dev: " << std::fixed << std::setprecision(2) 
-                  << get_latency_standard_deviation(operation) << " μs\n\n";
+
+    for (const auto& operation : metrics.operations) {
+        std::cout << operation.name << ":\n";
+        std::cout << "  Total Operations: " << operation.total_operations << "\n";
+        std::cout << "  Operations/sec: " << std::fixed << std::setprecision(2)
+                  << operation.operations_per_second << "\n";
+        std::cout << std::setprecision(3);
+        std::cout << "  Average Latency: " << operation.average_latency << " μs\n";
+        std::cout << "  Min Latency: " << operation.min_latency << " μs\n";
+        std::cout << "  Max Latency: " << operation.max_latency << " μs\n";
+        std::cout << "  P50 Latency: " << operation.p50_latency << " μs\n";
+        std::cout << "  P95 Latency: " << operation.p95_latency << " μs\n";
+        std::cout << "  P99 Latency: " << operation.p99_latency << " μs\n";
+        std::cout << "  P99.9 Latency: " << operation.p999_latency << " μs\n";
+        std::cout << "  P99.99 Latency: " << operation.p9999_latency << " μs\n";
+        std::cout << "  Std Dev: " << operation.standard_deviation << " μs\n";
+        if (metrics.allocations_tracked && operation.allocations.spans > 0) {
+            const auto& allocations = operation.allocations;
+            std::cout << std::setprecision(2) << "  Allocations/span: "
+                      << static_cast<double>(allocations.allocations) / allocations.spans << " ("
+                      << static_cast<double>(allocations.bytes) / allocations.spans << " bytes), max "
+                      << allocations.max_allocations << ", " << allocations.allocating_spans << " of "
+                      << allocations.spans << " spans allocated\n";
+        }
+        for (const auto& window : operation.windows) {
+            std::cout << "  Last " << window.name << ": " << std::setprecision(2)
+                      << window.operations_per_second << " ops/sec, P99 " << std::setprecision(3)
+                      << window.p99_latency << " μs, P99.9 " << window.p999_latency << " μs\n";
+        }
+        std::cout << "\n";
     }
 }
 
 std::string PerformanceMonitor::get_metrics_json() const {
-    std::lock_guard<std::mutex> lock(m_metrics_mutex);
+    return format_metrics_json(snapshot());
+}
+
+std::string PerformanceMonitor::format_metrics_json(const MetricsSnapshot& snapshot_state, bool single_line) {
     Json::Value root;
-    
-    for (const auto& pair : m_metrics) {
-        const auto& operation = pair.first;
+
+    for (const auto& operation : snapshot_state.operations) {
         Json::Value metrics;
-        metrics["total_operations"] = Json::Value::UInt64(get_total_operations(operation));
-        metrics["operations_per_second"] = get_operations_per_second(operation);
-        metrics["average_latency"] = get_average_latency(operation);
-        metrics["min_latency"] = Json::Value::UInt64(get_min_latency(operation));
-        metrics["max_latency"] = Json::Value::UInt64(get_max_latency(operation));
-        metrics["p50_latency"] = get_latency_percentile(operation, 0.5);
-        metrics["p95_latency"] = get_latency_percentile(operation, 0.95);
-        metrics["p99_latency"] = get_latency_percentile(operation, 0.99);
-        metrics["standard_deviation"] = get_latency_standard_deviation(operation);
-        
-        root[operation] = metrics;
-    }
-    
+        metrics["total_operations"] = Json::Value::UInt64(operation.total_operations);
+        metrics["operations_per_second"] = operation.operations_per_second;
+        metrics["average_latency"] = operation.average_latency;
+        metrics["min_latency"] = operation.min_latency;
+        metrics["max_latency"] = operation.max_latency;
+        metrics["p50_latency"] = operation.p50_latency;
+        metrics["p95_latency"] = operation.p95_latency;
+        metrics["p99_latency"] = operation.p99_latency;
+        metrics["p999_latency"] = operation.p999_latency;
+        metrics["p9999_latency"] = operation.p9999_latency;
+        metrics["standard_deviation"] = operation.standard_deviation;
+        if (snapshot_state.allocations_tracked) {
+            Json::Value allocations;
+            allocations["spans"] = Json::Value::UInt64(operation.allocations.spans);
+            allocations["allocating_spans"] = Json::Value::UInt64(operation.allocations.allocating_spans);
+            allocations["allocations"] = Json::Value::UInt64(operation.allocations.allocations);
+            allocations["bytes"] = Json::Value::UInt64(operation.allocations.bytes);
+            allocations["max_allocations_per_span"] = Json::Value::UInt64(operation.allocations.max_allocations);
+            metrics["allocations"] = allocations;
+        }
+        for (const auto& window : operation.windows) {
+            Json::Value windowed;
+            windowed["operations_per_second"] = window.operations_per_second;
+            windowed["p50_latency"] = window.p50_latency;
+            windowed["p99_latency"] = window.p99_latency;
+            windowed["p999_latency"] = window.p999_latency;
+            windowed["max_latency"] = window.max_latency;
+            metrics["windows"][window.name] = windowed;
+        }
+
+        root[operation.name] = metrics;
+    }
+
     Json::StreamWriterBuilder writer;
+    if (single_line) {
+        writer["indentation"] = "";
+    }
     return Json::writeString(writer, root);
-} 
\ No newline at end of file
+}
+
+std::string PerformanceMonitor::get_metrics_openmetrics() const {
+    const MetricsSnapshot snapshot_state = snapshot();
+    std::ostringstream out;
+    out << std::setprecision(9);
+
+    out << "# TYPE quant_operation_latency_seconds histogram\n";
+    out << "# UNIT quant_operation_latency_seconds seconds\n";
+    out << "# HELP quant_operation_latency_seconds Operation latency since start.\n";
+    for (const auto& operation : snapshot_state.operations) {
+        const std::string label = "operation=\"" + openmetrics_label(operation.name) + "\"";
+        for (const auto& bucket : operation.buckets) {
+            out << "quant_operation_latency_seconds_bucket{" << label << ",le=\"" << bucket.upper_bound_ns / 1e9
+                << "\"} " << bucket.cumulative_count << "\n";
+        }
+        out << "quant_operation_latency_seconds_bucket{" << label << ",le=\"+Inf\"} "
+            << operation.total_operations << "\n";
+        out << "quant_operation_latency_seconds_count{" << label << "} " << operation.total_operations << "\n";
+        out << "quant_operation_latency_seconds_sum{" << label << "} " << operation.total_latency / 1e6 << "\n";
+    }
+
+    out << "# TYPE quant_operation_rate gauge\n";
+    out << "# HELP quant_operation_rate Operations per second over a trailing window.\n";
+    for (const auto& operation : snapshot_state.operations) {
+        for (const auto& window : operation.windows) {
+            out << "quant_operation_rate{operation=\"" << openmetrics_label(operation.name) << "\",window=\""
+                << window.name << "\"} " << window.operations_per_second << "\n";
+        }
+    }
+
+    out << "# TYPE quant_operation_window_latency_seconds gauge\n";
+    out << "# UNIT quant_operation_window_latency_seconds seconds\n";
+    out << "# HELP quant_operation_window_latency_seconds Latency quantile over a trailing window.\n";
+    for (const auto& operation : snapshot_state.operations) {
+        const std::string label = "operation=\"" + openmetrics_label(operation.name) + "\"";
+        for (const auto& window : operation.windows) {
+            const std::pair<const char*, double> quantiles[] = {
+                {"0.5", window.p50_latency}, {"0.99", window.p99_latency}, {"0.999", window.p999_latency}};
+            for (const auto& quantile : quantiles) {
+                out << "quant_operation_window_latency_seconds{" << label << ",window=\"" << window.name
+                    << "\",quantile=\"" << quantile.first << "\"} " << quantile.second / 1e6 << "\n";
+            }
+        }
+    }
+
+    if (snapshot_state.allocations_tracked) {
+        out << "# TYPE quant_operation_allocations counter\n";
+        out << "# HELP quant_operation_allocations Heap allocations made inside the operation's spans.\n";
+        for (const auto& operation : snapshot_state.operations) {
+            out << "quant_operation_allocations_total{operation=\"" << openmetrics_label(operation.name) << "\"} "
+                << operation.allocations.allocations << "\n";
+        }
+        out << "# TYPE quant_operation_allocated_bytes counter\n";
+        out << "# UNIT quant_operation_allocated_bytes bytes\n";
+        out << "# HELP quant_operation_allocated_bytes Heap bytes allocated inside the operation's spans.\n";
+        for (const auto& operation : snapshot_state.operations) {
+            out << "quant_operation_allocated_bytes_total{operation=\"" << openmetrics_label(operation.name) << "\"} "
+                << operation.allocations.bytes << "\n";
+        }
+    }
+
+    out << "# TYPE quant_monitor_ring_overflows counter\n";
+    out << "# HELP quant_monitor_ring_overflows Samples recorded under the lock because a thread ring was full.\n";
+    out << "quant_monitor_ring_overflows_total " << snapshot_state.ring_overflows << "\n";
+    out << "# TYPE quant_monitor_recording_threads gauge\n";
+    out << "# HELP quant_monitor_recording_threads Threads with a live recording ring.\n";
+    out << "quant_monitor_recording_threads " << snapshot_state.recording_threads << "\n";
+    out << "# TYPE quant_monitor_uptime_seconds gauge\n";
+    out << "quant_monitor_uptime_seconds " << snapshot_state.uptime_seconds << "\n";
+    out << "# EOF\n";
+    return out.str();
+}
+
+bool PerformanceMonitor::export_metrics_to_file(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << get_metrics_json();
+    return true;
+}
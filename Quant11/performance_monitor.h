@@ -1,117 +1,417 @@
 #pragma once
 
 #define _GLIBCXX_USE_CXX11_ABI 1
+#include "allocation_tracker.h"
+#include "latency_histogram.h"
+#include "rolling_histogram.h"
+#include "sample_ring.h"
+#include "span_ring.h"
+#include "tsc_clock.h"
 #include <string>
 #include <map>
+#include <deque>
 #include <vector>
+#include <memory>
+#include <unordered_map>
 #include <chrono>
 #include <mutex>
-#include <fstream>
-#include <algorithm>
-#include <numeric>
-#include <cmath>
-#include <limits>
+#include <condition_variable>
 #include <thread>
+#include <atomic>
+#include <algorithm>
+
+// Lightweight reference to a registered metric: an index into the monitor's
+// dense metric array, so recording by handle does no string work.
+struct MetricHandle {
+    uint32_t index;
+};
+
+// Metrics on the built-in hot paths. They are registered by every monitor in
+// this order, so their handles are known at compile time.
+enum class BuiltinMetric : uint32_t {
+    WebSocketBroadcast,
+    SubscriptionHandling,
+    WebSocketMessageProcessing,
+    // Tick-to-trade stages: time since the previous marked stage
+    TickToTradeParse,
+    TickToTradeBookUpdate,
+    TickToTradeStrategy,
+    TickToTradeOrderSend,
+    TickToTradeAck,
+    // Tick-to-trade: receive to ack
+    TickToTradeTotal,
+    // Order placement round trip, and any REST request to the exchange
+    OrderPlacement,
+    ApiRequest,
+    Count
+};
+
+// Stages of the tick-to-trade path a single market data event is traced through
+enum class TradeStage : uint32_t {
+    Receive,
+    Parse,
+    BookUpdate,
+    Strategy,
+    OrderSend,
+    Ack
+};
+
+// What a sample was working on, kept only if the sample turns out to be an
+// outlier. Fixed size so attaching it to a span never allocates.
+struct SampleContext {
+    // Truncated to fit
+    char instrument[32];
+    uint32_t queue_depth;
+    uint32_t message_size;
+
+    SampleContext() : instrument{}, queue_depth(0), message_size(0) {}
+    SampleContext(const std::string& instrument_name, uint32_t depth, uint32_t size)
+        : instrument{}, queue_depth(depth), message_size(size) {
+        instrument_name.copy(instrument, sizeof(instrument) - 1);
+    }
+};
+
+// A sample that exceeded its metric's outlier threshold
+struct OutlierRecord {
+    std::string operation;
+    std::string instrument;
+    uint64_t latency_ns;
+    // PerformanceMonitor::now_ns() timeline, as in trace dumps
+    uint64_t timestamp_ns;
+    // System clock, for correlating with logs
+    uint64_t wall_clock_ns;
+    // Same id as the thread's trace events
+    uint32_t thread_id;
+    uint32_t queue_depth;
+    uint32_t message_size;
+};
+
+// Point-in-time statistics for every operation, computed in one pass over a
+// copy of the monitor's state. Latencies are in microseconds.
+struct MetricsSnapshot {
+    struct Window {
+        const char* name;
+        std::chrono::seconds span;
+        double operations_per_second;
+        double p50_latency;
+        double p99_latency;
+        double p999_latency;
+        double max_latency;
+    };
+
+    struct Bucket {
+        uint64_t upper_bound_ns;
+        // Operations that took at most upper_bound_ns
+        uint64_t cumulative_count;
+    };
+
+    struct Operation {
+        std::string name;
+        uint64_t total_operations;
+        // Lifetime rate; see windows for current rates
+        double operations_per_second;
+        double average_latency;
+        double min_latency;
+        double max_latency;
+        double p50_latency;
+        double p95_latency;
+        double p99_latency;
+        double p999_latency;
+        double p9999_latency;
+        double standard_deviation;
+        double total_latency;
+        // Heap allocations inside this operation's spans; populated when
+        // allocations_tracked
+        AllocationTotals allocations;
+        std::vector<Bucket> buckets;
+        // 1s, 10s, 60s and 5m trailing windows
+        std::vector<Window> windows;
+    };
 
+    double uptime_seconds = 0.0;
+    uint64_t ring_overflows = 0;
+    size_t recording_threads = 0;
+    // Built with QUANT_TRACK_ALLOCATIONS
+    bool allocations_tracked = false;
+    // Ordered by operation name
+    std::vector<Operation> operations;
+};
+
+// Latency recording is split in two: each recording thread pushes samples
+// into its own lock-free ring, and a background aggregator merges the rings
+// into the per-operation histograms that every query reads. Queries flush the
+// rings first, so they see every sample recorded before the call.
 class PerformanceMonitor {
 public:
     struct Metrics {
-        size_t total_count = 0;
-        double total_latency = 0.0;
-        double min_latency = std::numeric_limits<double>::max();
-        double max_latency = 0.0;
-        std::vector<double> latency_samples;
-        static constexpr size_t MAX_SAMPLES = 1000;
+        // Fixed-size distribution of every recorded latency, in nanoseconds
+        LatencyHistogram latency_histogram;
+        // The same samples over trailing windows, at reduced precision
+        RollingHistogram recent;
+        // Allocations from threads that have since exited
+        AllocationTotals retired_allocations;
+
+        Metrics(uint64_t highest_trackable_ns, int significant_digits)
+            : latency_histogram(highest_trackable_ns, significant_digits),
+              recent(highest_trackable_ns, std::min(significant_digits, 2)) {}
     };
 
-    void record_latency(const std::string& operation, double latency_ms) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        auto& metrics = m_metrics[operation];
-        metrics.total_count++;
-        metrics.total_latency += latency_ms;
-        metrics.min_latency = std::min(metrics.min_latency, latency_ms);
-        metrics.max_latency = std::max(metrics.max_latency, latency_ms);
-        
-        if (metrics.latency_samples.size() < Metrics::MAX_SAMPLES) {
-            metrics.latency_samples.push_back(latency_ms);
-        } else {
-            metrics.latency_samples[metrics.total_count % Metrics::MAX_SAMPLES] = latency_ms;
-        }
-    }
+    // Latencies above highest_trackable_ns are clamped; significant_digits
+    // (1-5) trades histogram memory for percentile precision. Latencies are
+    // stored in nanoseconds; the query and report APIs return microseconds.
+    explicit PerformanceMonitor(uint64_t highest_trackable_ns = 3600ULL * 1000 * 1000 * 1000,
+                                int significant_digits = 3);
+    ~PerformanceMonitor();
 
-    Metrics get_metrics(const std::string& operation) const {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        auto it = m_metrics.find(operation);
-        return it != m_metrics.end() ? it->second : Metrics();
-    }
+    PerformanceMonitor(const PerformanceMonitor&) = delete;
+    PerformanceMonitor& operator=(const PerformanceMonitor&) = delete;
 
-    void clear_metrics(const std::string& operation) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_metrics.erase(operation);
+    // Returns the handle for the named metric, registering it on first use.
+    // Intended for startup; the handle is valid for the monitor's lifetime.
+    MetricHandle register_metric(const std::string& operation);
+    static constexpr MetricHandle builtin_handle(BuiltinMetric metric) {
+        return MetricHandle{static_cast<uint32_t>(metric)};
     }
 
-    void clear_all_metrics() {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_metrics.clear();
-    }
+    // Timestamp source for latency measurement: TSC-backed where invariant
+    static uint64_t now_ns() { return TscClock::now_ns(); }
 
-    std::string get_metrics_json() const {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        std::string json = "{\n";
-        for (const auto& pair : m_metrics) {
-            const auto& operation = pair.first;
-            const auto& metrics = pair.second;
-            json += "  \"" + operation + "\": {\n";
-            json += "    \"total_count\": " + std::to_string(metrics.total_count) + ",\n";
-            json += "    \"avg_latency\": " + std::to_string(metrics.total_latency / metrics.total_count) + ",\n";
-            json += "    \"min_latency\": " + std::to_string(metrics.min_latency) + ",\n";
-            json += "    \"max_latency\": " + std::to_string(metrics.max_latency) + ",\n";
-            
-            if (!metrics.latency_samples.empty()) {
-                double mean = metrics.total_latency / metrics.total_count;
-                double variance = 0.0;
-                for (double sample : metrics.latency_samples) {
-                    variance += std::pow(sample - mean, 2);
-                }
-                variance /= metrics.latency_samples.size();
-                
-                json += "    \"std_dev\": " + std::to_string(std::sqrt(variance)) + ",\n";
-                json += "    \"p95\": " + std::to_string(calculate_percentile(metrics.latency_samples, 95)) + ",\n";
-                json += "    \"p99\": " + std::to_string(calculate_percentile(metrics.latency_samples, 99)) + "\n";
-            } else {
-                json += "    \"std_dev\": 0.0,\n";
-                json += "    \"p95\": 0.0,\n";
-                json += "    \"p99\": 0.0\n";
-            }
-            
-            json += "  },\n";
-        }
-        if (!m_metrics.empty()) {
-            json.pop_back(); // Remove trailing comma
-            json.pop_back(); // Remove newline
-        }
-        json += "\n}\n";
-        return json;
+    void record_latency_ns(MetricHandle metric, uint64_t latency_ns);
+    void record_latency_ns(BuiltinMetric metric, uint64_t latency_ns) {
+        record_latency_ns(builtin_handle(metric), latency_ns);
+    }
+    void record_latency(MetricHandle metric, uint64_t latency_us) {
+        record_latency_ns(metric, latency_us * 1000);
+    }
+    void record_latency(BuiltinMetric metric, uint64_t latency_us) {
+        record_latency_ns(builtin_handle(metric), latency_us * 1000);
+    }
+    // Records a sample with context for outlier capture
+    void record_latency_ns(MetricHandle metric, uint64_t latency_ns, const SampleContext& context) {
+        record_sample_ns(metric, latency_ns, &context);
     }
+    // Convenience overload that looks the name up in a per-thread cache
+    void record_latency(const std::string& operation, uint64_t latency_us);
+
+    // Spans on the calling thread; end records the time since the matching
+    // start. Spans may nest. Prefer ScopedSpan where the scope fits.
+    void start_operation(MetricHandle metric);
+    void end_operation(MetricHandle metric);
+    void start_operation(const std::string& operation);
+    void end_operation(const std::string& operation);
+    // Records a completed span: its latency and, while tracing, its timeline entry
+    void record_span(MetricHandle metric, uint64_t start_ns, uint64_t end_ns,
+                     const SampleContext* context = nullptr);
+    // Attributes the heap allocations made during one span of metric on the
+    // calling thread. Spans call this themselves when allocations are tracked.
+    void record_allocations(MetricHandle metric, const AllocationCounters& allocated);
+
+    // Tick-to-trade tracing across threads. begin_trace marks Receive and
+    // returns the event's correlation id; each mark_stage records the time
+    // since the previously marked stage, and Ack also records the total.
+    // Traces live in a fixed table, so a trace that is never acked is simply
+    // overwritten by a later one.
+    uint64_t begin_trace();
+    void mark_stage(uint64_t correlation_id, TradeStage stage);
+
+    // Timeline tracing. While enabled, every span (ScopedSpan, start/end and
+    // tick-to-trade stages) is also kept in a per-thread flight recorder of
+    // the last spans_per_thread spans, which can be dumped as Chrome
+    // trace-event JSON for chrome://tracing or Perfetto.
+    void enable_tracing(size_t spans_per_thread = 65536);
+    void disable_tracing();
+    // Labels the calling thread in trace dumps
+    void set_thread_name(const std::string& name);
+    std::string get_trace_json() const;
+    bool dump_trace(const std::string& filename) const;
+    // Dumps the trace to <filename_prefix>.<n>.json when a span of metric
+    // takes longer than threshold_ns. The dump runs on the aggregator thread,
+    // at most once per second, and only while tracing is enabled.
+    void set_trace_trigger(MetricHandle metric, uint64_t threshold_ns, const std::string& filename_prefix);
+    void clear_trace_trigger();
 
-    bool export_metrics_to_file(const std::string& filename) const {
-        std::ofstream file(filename);
-        if (!file.is_open()) {
-            return false;
+    // Outlier capture. Samples of metric slower than threshold_ns are kept,
+    // with their context, in a bounded ring of the most recent outliers.
+    // Checking costs one atomic load per sample; only outliers take a lock.
+    void set_outlier_threshold(MetricHandle metric, uint64_t threshold_ns);
+    void clear_outlier_threshold(MetricHandle metric);
+    // Oldest first
+    std::vector<OutlierRecord> get_outliers() const;
+    std::string get_outliers_json() const;
+    bool dump_outliers(const std::string& filename) const;
+    void clear_outliers();
+
+    // Merges every thread's pending samples into the aggregated metrics
+    void flush() const;
+
+    double get_average_latency(const std::string& operation) const;
+    uint64_t get_min_latency(const std::string& operation) const;
+    uint64_t get_max_latency(const std::string& operation) const;
+    uint64_t get_total_operations(const std::string& operation) const;
+    double get_operations_per_second(const std::string& operation) const;
+    // percentile in [0, 1], e.g. 0.999 for p99.9
+    double get_latency_percentile(const std::string& operation, double percentile) const;
+    double get_latency_standard_deviation(const std::string& operation) const;
+
+    // Rate and percentiles over a trailing window (up to 5 minutes) rather
+    // than the monitor's lifetime
+    double get_operations_per_second(const std::string& operation, std::chrono::seconds window) const;
+    double get_latency_percentile(const std::string& operation, double percentile,
+                                  std::chrono::seconds window) const;
+
+    void clear_metrics(const std::string& operation);
+    void clear_all_metrics();
+
+    // Every statistic for every operation at once. The state is copied under
+    // the lock and the statistics computed after releasing it, so exporters
+    // never hold up the aggregator; recorders are never blocked.
+    MetricsSnapshot snapshot() const;
+
+    void print_metrics() const;
+    std::string get_metrics_json() const;
+    // The JSON document for an existing snapshot; single_line drops all
+    // whitespace so the result can be one record of a JSON lines file
+    static std::string format_metrics_json(const MetricsSnapshot& snapshot, bool single_line = false);
+    // OpenMetrics text exposition: a latency histogram per operation, plus
+    // windowed rate and quantile gauges and the monitor's own counters
+    std::string get_metrics_openmetrics() const;
+    // Runs on the caller's thread; MetricsExporter writes periodic snapshots
+    // from a background thread instead
+    bool export_metrics_to_file(const std::string& filename) const;
+
+private:
+    struct OpenSpan {
+        uint32_t metric;
+        uint64_t start_ns;
+        AllocationCounters allocations;
+    };
+
+    // Per-thread recording state, shared with the monitor so samples pushed
+    // just before a thread exits are still aggregated
+    struct ThreadBuffer {
+        SampleRing ring;
+        // Operation name -> metric id, only touched by the owning thread
+        std::unordered_map<std::string, uint32_t> metric_ids;
+        // Open spans, only touched by the owning thread
+        std::vector<OpenSpan> open_spans;
+        // Allocation stats indexed by metric id; grown under m_buffers_mutex
+        std::deque<AllocationStats> allocations;
+        std::atomic<bool> retired{false};
+        // Trace identity and flight recorder; written under m_buffers_mutex
+        uint32_t thread_id;
+        std::string thread_name;
+        std::shared_ptr<SpanRing> spans;
+        // Outlier thresholds by metric id, copied from the monitor whenever
+        // its version moves; only touched by the owning thread
+        uint64_t outlier_version = 0;
+        std::vector<uint64_t> outlier_thresholds;
+
+        ThreadBuffer(size_t capacity, uint32_t id) : ring(capacity), thread_id(id) {}
+    };
+
+    // In-flight tick-to-trade trace
+    struct TraceSlot {
+        std::atomic<uint64_t> correlation_id{0};
+        std::atomic<uint64_t> origin_ns{0};
+        std::atomic<uint64_t> last_ns{0};
+    };
+
+    ThreadBuffer& thread_buffer();
+    uint32_t thread_metric_id(ThreadBuffer& buffer, const std::string& operation);
+    const Metrics* find_metrics(const std::string& operation) const;
+    double operations_per_second(const Metrics& metrics) const;
+    void record_sample(Metrics& metrics, uint64_t latency_ns, uint64_t now) const;
+    void aggregator_loop();
+    void trace_span(ThreadBuffer& buffer, uint32_t metric, uint64_t start_ns, uint64_t duration_ns);
+    void dump_triggered_trace();
+    void reset_thread_allocations(uint32_t metric) const;
+    void record_sample_ns(MetricHandle metric, uint64_t latency_ns, const SampleContext* context);
+    void refresh_outlier_thresholds(ThreadBuffer& buffer);
+    void capture_outlier(const ThreadBuffer& buffer, uint32_t metric, uint64_t latency_ns,
+                         const SampleContext* context);
+
+    const uint64_t m_id;
+    uint64_t m_highest_trackable_ns;
+    int m_significant_digits;
+
+    // Aggregated state; readers flush into it too, hence mutable
+    mutable std::mutex m_metrics_mutex;
+    mutable std::deque<Metrics> m_metrics;
+    std::map<std::string, uint32_t> m_metric_ids;
+    std::chrono::steady_clock::time_point m_start_time;
+
+    std::unique_ptr<TraceSlot[]> m_traces;
+    std::atomic<uint64_t> m_next_correlation_id{1};
+
+    // Samples recorded directly because a thread's ring was full
+    std::atomic<uint64_t> m_ring_overflows{0};
+
+    mutable std::mutex m_buffers_mutex;
+    mutable std::vector<std::shared_ptr<ThreadBuffer>> m_thread_buffers;
+    std::atomic<uint32_t> m_next_thread_id{1};
+
+    // Spans per thread ring while tracing, 0 when disabled
+    std::atomic<size_t> m_trace_capacity{0};
+    std::atomic<uint32_t> m_trigger_metric;
+    std::atomic<uint64_t> m_trigger_threshold_ns{0};
+    std::atomic<bool> m_trigger_fired{false};
+    std::mutex m_trigger_mutex;
+    std::string m_trigger_prefix;
+    uint64_t m_trigger_dumps = 0;
+    std::chrono::steady_clock::time_point m_last_trigger_dump;
+
+    struct Outlier {
+        uint32_t metric;
+        uint32_t thread_id;
+        uint64_t latency_ns;
+        uint64_t timestamp_ns;
+        uint64_t wall_clock_ns;
+        SampleContext context;
+    };
+    std::atomic<uint64_t> m_outlier_version{0};
+    mutable std::mutex m_outlier_mutex;
+    std::vector<uint64_t> m_outlier_thresholds;
+    // Ring of the most recent outliers; m_outlier_count ever captured
+    std::vector<Outlier> m_outliers;
+    uint64_t m_outlier_count = 0;
+
+    std::mutex m_aggregator_mutex;
+    std::condition_variable m_aggregator_cv;
+    bool m_stopping = false;
+    std::thread m_aggregator;
+};
+
+// Records the lifetime of the enclosing scope as one latency sample
+class ScopedSpan {
+public:
+    ScopedSpan(PerformanceMonitor& monitor, MetricHandle metric)
+        : m_monitor(monitor), m_metric(metric), m_start_allocations(AllocationTracker::thread_counters()),
+          m_start_ns(PerformanceMonitor::now_ns()) {}
+    ScopedSpan(PerformanceMonitor& monitor, BuiltinMetric metric)
+        : ScopedSpan(monitor, PerformanceMonitor::builtin_handle(metric)) {}
+    ~ScopedSpan() {
+        const uint64_t end_ns = PerformanceMonitor::now_ns();
+        const AllocationCounters allocated = AllocationTracker::thread_counters() - m_start_allocations;
+        m_monitor.record_span(m_metric, m_start_ns, end_ns, m_has_context ? &m_context : nullptr);
+        if (AllocationTracker::enabled) {
+            m_monitor.record_allocations(m_metric, allocated);
         }
-        file << get_metrics_json();
-        return true;
     }
 
-private:
-    double calculate_percentile(const std::vector<double>& samples, double percentile) const {
-        if (samples.empty()) return 0.0;
-        std::vector<double> sorted_samples = samples;
-        std::sort(sorted_samples.begin(), sorted_samples.end());
-        size_t index = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted_samples.size())) - 1;
-        return sorted_samples[index];
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+    // Attached to the sample if the span turns out to be an outlier
+    void set_context(const SampleContext& context) {
+        m_context = context;
+        m_has_context = true;
     }
 
-    mutable std::mutex m_mutex;
-    std::map<std::string, Metrics> m_metrics;
-}; 
\ No newline at end of file
+private:
+    PerformanceMonitor& m_monitor;
+    MetricHandle m_metric;
+    AllocationCounters m_start_allocations;
+    uint64_t m_start_ns;
+    bool m_has_context = false;
+    SampleContext m_context;
+};
@@ -0,0 +1,92 @@
+#include "rolling_histogram.h"
+#include <algorithm>
+
+namespace {
+const uint64_t NS_PER_SECOND = 1000000000ULL;
+}
+
+RollingHistogram::RollingHistogram(uint64_t highest_trackable_value, int significant_digits)
+    : m_highest_trackable_value(highest_trackable_value),
+      m_significant_digits(significant_digits),
+      m_fine{NS_PER_SECOND, 11, {}, {}},
+      m_coarse{10 * NS_PER_SECOND, 31, {}, {}} {}
+
+void RollingHistogram::record(uint64_t value, uint64_t now_ns) {
+    if (m_fine.slots.empty()) {
+        m_first_record_ns = now_ns;
+    }
+    record(m_fine, value, now_ns);
+    record(m_coarse, value, now_ns);
+}
+
+void RollingHistogram::record(Level& level, uint64_t value, uint64_t now_ns) {
+    if (level.slots.empty()) {
+        level.slots.assign(level.slot_count, LatencyHistogram(m_highest_trackable_value, m_significant_digits));
+        level.epochs.assign(level.slot_count, 0);
+    }
+    // Epochs start at 1 so a zeroed slot never looks current
+    const uint64_t epoch = now_ns / level.slot_ns + 1;
+    const size_t index = static_cast<size_t>(epoch % level.slot_count);
+    if (level.epochs[index] != epoch) {
+        level.slots[index].reset();
+        level.epochs[index] = epoch;
+    }
+    level.slots[index].record(value);
+}
+
+const RollingHistogram::Level& RollingHistogram::level_for(std::chrono::seconds span) const {
+    const uint64_t span_ns = static_cast<uint64_t>(span.count()) * NS_PER_SECOND;
+    return span_ns <= m_fine.slot_ns * (m_fine.slot_count - 1) ? m_fine : m_coarse;
+}
+
+// The window is the current, partially filled slot plus enough whole slots
+// before it to cover the span, so it covers between span and span plus one
+// slot. It is clamped to the history kept and to the time since the first
+// record.
+uint64_t RollingHistogram::collect(const Level& level, std::chrono::seconds span, uint64_t now_ns,
+                                   LatencyHistogram* merged, uint64_t* count) const {
+    if (level.slots.empty()) {
+        return 0;
+    }
+    const uint64_t span_ns = static_cast<uint64_t>(span.count()) * NS_PER_SECOND;
+    const uint64_t whole_slots = std::min<uint64_t>((span_ns + level.slot_ns - 1) / level.slot_ns,
+                                                    level.slot_count - 1);
+    const uint64_t current_epoch = now_ns / level.slot_ns + 1;
+
+    for (uint64_t back = 0; back <= whole_slots && back < current_epoch; ++back) {
+        const uint64_t epoch = current_epoch - back;
+        const size_t index = static_cast<size_t>(epoch % level.slot_count);
+        if (level.epochs[index] != epoch) {
+            continue;
+        }
+        if (merged) {
+            merged->merge(level.slots[index]);
+        }
+        if (count) {
+            *count += level.slots[index].total_count();
+        }
+    }
+
+    const uint64_t covered = whole_slots * level.slot_ns + now_ns % level.slot_ns;
+    return std::min(covered, now_ns - std::min(now_ns, m_first_record_ns));
+}
+
+LatencyHistogram RollingHistogram::window(std::chrono::seconds span, uint64_t now_ns) const {
+    LatencyHistogram merged(m_highest_trackable_value, m_significant_digits);
+    collect(level_for(span), span, now_ns, &merged, nullptr);
+    return merged;
+}
+
+double RollingHistogram::rate(std::chrono::seconds span, uint64_t now_ns) const {
+    uint64_t count = 0;
+    const uint64_t covered_ns = collect(level_for(span), span, now_ns, nullptr, &count);
+    return covered_ns > 0 ? static_cast<double>(count) * NS_PER_SECOND / covered_ns : 0.0;
+}
+
+void RollingHistogram::reset() {
+    for (Level* level : {&m_fine, &m_coarse}) {
+        level->slots.clear();
+        level->epochs.clear();
+    }
+    m_first_record_ns = 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "latency_histogram.h"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Latency distribution over trailing time windows, kept as rings of
+// histograms: 1s slots answer windows up to 10s and 10s slots answer windows
+// up to 5m. A window query merges the whole slots that cover the span plus
+// the slot still filling, so the 10s window is ten 1s slots and covers 10-11s.
+// Each ring keeps one slot beyond its longest window for the filling slot.
+// A spike shows up for as long as it is inside the window and then ages out.
+// Slots are allocated on the first record.
+class RollingHistogram {
+public:
+    RollingHistogram(uint64_t highest_trackable_value, int significant_digits);
+
+    void record(uint64_t value, uint64_t now_ns);
+
+    // Merged distribution of the samples recorded in the trailing window
+    // ending at now_ns. Windows longer than the 5m history are truncated.
+    LatencyHistogram window(std::chrono::seconds span, uint64_t now_ns) const;
+    // Samples per second over the same window
+    double rate(std::chrono::seconds span, uint64_t now_ns) const;
+
+    void reset();
+
+private:
+    struct Level {
+        uint64_t slot_ns;
+        size_t slot_count;
+        std::vector<LatencyHistogram> slots;
+        std::vector<uint64_t> epochs;
+    };
+
+    const Level& level_for(std::chrono::seconds span) const;
+    // Merges the slots covering the window; returns the covered duration in ns
+    uint64_t collect(const Level& level, std::chrono::seconds span, uint64_t now_ns,
+                     LatencyHistogram* merged, uint64_t* count) const;
+    void record(Level& level, uint64_t value, uint64_t now_ns);
+
+    uint64_t m_highest_trackable_value;
+    int m_significant_digits;
+    uint64_t m_first_record_ns = 0;
+    Level m_fine;
+    Level m_coarse;
+};
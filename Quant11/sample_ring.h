@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Bounded single-producer/single-consumer ring of latency samples. The owning
+// thread pushes without locks; the aggregator drains. Producer and consumer
+// indices sit on separate cache lines so they only share a line when the
+// consumer actually reads new samples.
+class SampleRing {
+public:
+    struct Sample {
+        uint32_t metric;
+        uint64_t value;
+    };
+
+    // capacity is rounded up to a power of two
+    explicit SampleRing(size_t capacity) {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        m_buffer.resize(rounded);
+        m_mask = rounded - 1;
+    }
+
+    SampleRing(const SampleRing&) = delete;
+    SampleRing& operator=(const SampleRing&) = delete;
+
+    // Producer side. Returns false when the ring is full.
+    bool push(uint32_t metric, uint64_t value) {
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cached_tail > m_mask) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cached_tail > m_mask) {
+                return false;
+            }
+        }
+        Sample& slot = m_buffer[head & m_mask];
+        slot.metric = metric;
+        slot.value = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Calls on_sample for every sample pushed so far.
+    template <typename F>
+    size_t drain(F&& on_sample) {
+        const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        for (uint64_t i = tail; i != head; ++i) {
+            on_sample(m_buffer[i & m_mask]);
+        }
+        m_tail.store(head, std::memory_order_release);
+        return static_cast<size_t>(head - tail);
+    }
+
+    bool empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<Sample> m_buffer;
+    size_t m_mask = 0;
+
+    char m_pad0[64];
+    std::atomic<uint64_t> m_head{0};
+    uint64_t m_cached_tail = 0;
+    char m_pad1[64];
+    std::atomic<uint64_t> m_tail{0};
+    char m_pad2[64];
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Flight recorder of completed spans for one thread. The owning thread
+// records without locks and overwrites the oldest spans once full; any other
+// thread may read a copy at any time. Each slot carries a sequence number
+// written odd before and even after the update (a per-slot seqlock), so a
+// reader skips slots that are being overwritten instead of blocking the writer.
+class SpanRing {
+public:
+    struct Span {
+        uint32_t metric;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+    };
+
+    // capacity is rounded up to a power of two
+    explicit SpanRing(size_t capacity) {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        m_slots = std::vector<Slot>(rounded);
+        m_mask = rounded - 1;
+    }
+
+    SpanRing(const SpanRing&) = delete;
+    SpanRing& operator=(const SpanRing&) = delete;
+
+    // Owning thread only
+    void record(uint32_t metric, uint64_t start_ns, uint64_t duration_ns) {
+        const uint64_t index = m_head.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[index & m_mask];
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.metric.store(metric, std::memory_order_relaxed);
+        slot.start_ns.store(start_ns, std::memory_order_relaxed);
+        slot.duration_ns.store(duration_ns, std::memory_order_relaxed);
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+        m_head.store(index + 1, std::memory_order_release);
+    }
+
+    // Any thread. Calls on_span for each retained span, oldest first.
+    template <typename F>
+    void for_each(F&& on_span) const {
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        const uint64_t first = head > m_mask + 1 ? head - (m_mask + 1) : 0;
+        for (uint64_t index = first; index != head; ++index) {
+            const Slot& slot = m_slots[index & m_mask];
+            const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence != 2 * index + 2) {
+                continue;  // Being overwritten, or already lapped
+            }
+            const Span span{slot.metric.load(std::memory_order_relaxed),
+                            slot.start_ns.load(std::memory_order_relaxed),
+                            slot.duration_ns.load(std::memory_order_relaxed)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+                on_span(span);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<uint32_t> metric{0};
+        std::atomic<uint64_t> start_ns{0};
+        std::atomic<uint64_t> duration_ns{0};
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_mask = 0;
+    std::atomic<uint64_t> m_head{0};
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <functional>
+
+// Resolves symbols to subscribers for exact keys ("BTC-PERPETUAL") and
+// wildcard patterns ("BTC-*", "*-PERPETUAL", "BTC-*-C", "*").
+//
+// Prefix patterns live in a forward trie and suffix patterns in a trie keyed on
+// the reversed suffix, so resolving a symbol is a single walk per trie. Patterns
+// with the wildcard elsewhere are kept in a small list and glob-matched. The
+// resolved subscriber list is cached per symbol that has subscribers, so
+// steady-state broadcasts are a single hash lookup. Changing a subscription
+// drops the cache entries of the symbols it matches: one lookup for an exact
+// key, a pass over the cache for a wildcard.
+template <typename Subscriber, typename Compare = std::less<Subscriber>>
+class SubscriptionMatcher {
+public:
+    using SubscriberSet = std::set<Subscriber, Compare>;
+    using SubscriberList = std::vector<Subscriber>;
+
+    static constexpr char WILDCARD = '*';
+
+    static bool is_pattern(const std::string& key) {
+        return key.find(WILDCARD) != std::string::npos;
+    }
+
+    // Glob match where '*' matches any (possibly empty) run of characters.
+    static bool matches(const std::string& pattern, const std::string& symbol) {
+        size_t p = 0, s = 0;
+        size_t star = std::string::npos, backtrack = 0;
+        while (s < symbol.size()) {
+            if (p < pattern.size() && pattern[p] == WILDCARD) {
+                star = p++;
+                backtrack = s;
+            } else if (p < pattern.size() && pattern[p] == symbol[s]) {
+                ++p;
+                ++s;
+            } else if (star != std::string::npos) {
+                p = star + 1;
+                s = ++backtrack;
+            } else {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == WILDCARD) {
+            ++p;
+        }
+        return p == pattern.size();
+    }
+
+    // Returns true if the subscriber was not already subscribed to the key.
+    bool add(const std::string& key, const Subscriber& subscriber) {
+        bool inserted = false;
+        switch (classify(key)) {
+            case Kind::Exact:
+                inserted = m_exact[key].insert(subscriber).second;
+                if (inserted) {
+                    m_resolved.erase(key);
+                }
+                return inserted;
+            case Kind::Prefix:
+                inserted = insert_path(m_prefix_root, key.begin(), key.end() - 1).insert(subscriber).second;
+                break;
+            case Kind::Suffix:
+                inserted = insert_path(m_suffix_root, key.rbegin(), key.rend() - 1).insert(subscriber).second;
+                break;
+            case Kind::Glob:
+                inserted = m_globs[key].insert(subscriber).second;
+                break;
+        }
+        if (inserted) {
+            invalidate_matching(key);
+        }
+        return inserted;
+    }
+
+    // Returns true if the subscriber was subscribed to the key.
+    bool remove(const std::string& key, const Subscriber& subscriber) {
+        bool erased = false;
+        switch (classify(key)) {
+            case Kind::Exact: {
+                auto it = m_exact.find(key);
+                if (it == m_exact.end()) {
+                    return false;
+                }
+                erased = it->second.erase(subscriber) > 0;
+                if (it->second.empty()) {
+                    m_exact.erase(it);
+                }
+                if (erased) {
+                    m_resolved.erase(key);
+                }
+                return erased;
+            }
+            case Kind::Prefix:
+                erased = erase_path(m_prefix_root, key.begin(), key.end() - 1, subscriber);
+                break;
+            case Kind::Suffix:
+                erased = erase_path(m_suffix_root, key.rbegin(), key.rend() - 1, subscriber);
+                break;
+            case Kind::Glob: {
+                auto it = m_globs.find(key);
+                if (it == m_globs.end()) {
+                    return false;
+                }
+                erased = it->second.erase(subscriber) > 0;
+                if (it->second.empty()) {
+                    m_globs.erase(it);
+                }
+                break;
+            }
+        }
+        if (erased) {
+            invalidate_matching(key);
+        }
+        return erased;
+    }
+
+    // Subscribers for a concrete symbol, each listed once. The reference stays
+    // valid until the next add/remove/clear.
+    const SubscriberList& resolve(const std::string& symbol) {
+        auto cached = m_resolved.find(symbol);
+        if (cached != m_resolved.end()) {
+            return cached->second;
+        }
+
+        SubscriberSet subscribers;
+        auto exact = m_exact.find(symbol);
+        if (exact != m_exact.end()) {
+            subscribers.insert(exact->second.begin(), exact->second.end());
+        }
+        collect_path(m_prefix_root, symbol.begin(), symbol.end(), subscribers);
+        collect_path(m_suffix_root, symbol.rbegin(), symbol.rend(), subscribers);
+        for (const auto& glob : m_globs) {
+            if (matches(glob.first, symbol)) {
+                subscribers.insert(glob.second.begin(), glob.second.end());
+            }
+        }
+
+        // Symbols nobody subscribes to are not cached, so a feed with many
+        // unwatched instruments cannot grow the cache without bound
+        if (subscribers.empty()) {
+            static const SubscriberList no_subscribers;
+            return no_subscribers;
+        }
+        auto& resolved = m_resolved[symbol];
+        resolved.assign(subscribers.begin(), subscribers.end());
+        return resolved;
+    }
+
+    void clear() {
+        m_exact.clear();
+        m_globs.clear();
+        m_prefix_root = TrieNode();
+        m_suffix_root = TrieNode();
+        m_resolved.clear();
+    }
+
+private:
+    enum class Kind { Exact, Prefix, Suffix, Glob };
+
+    struct TrieNode {
+        std::map<char, std::unique_ptr<TrieNode>> children;
+        SubscriberSet subscribers;
+    };
+
+    // Drops the cached symbols a wildcard pattern matches; the rest stay warm
+    void invalidate_matching(const std::string& pattern) {
+        for (auto it = m_resolved.begin(); it != m_resolved.end();) {
+            if (matches(pattern, it->first)) {
+                it = m_resolved.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static Kind classify(const std::string& key) {
+        size_t stars = std::count(key.begin(), key.end(), WILDCARD);
+        if (stars == 0) {
+            return Kind::Exact;
+        }
+        if (stars == 1 && key.back() == WILDCARD) {
+            return Kind::Prefix;
+        }
+        if (stars == 1 && key.front() == WILDCARD) {
+            return Kind::Suffix;
+        }
+        return Kind::Glob;
+    }
+
+    template <typename It>
+    static SubscriberSet& insert_path(TrieNode& root, It first, It last) {
+        TrieNode* node = &root;
+        for (; first != last; ++first) {
+            auto& child = node->children[*first];
+            if (!child) {
+                child.reset(new TrieNode());
+            }
+            node = child.get();
+        }
+        return node->subscribers;
+    }
+
+    // Erases the subscriber at the end of the path and prunes emptied nodes.
+    template <typename It>
+    static bool erase_path(TrieNode& node, It first, It last, const Subscriber& subscriber) {
+        if (first == last) {
+            return node.subscribers.erase(subscriber) > 0;
+        }
+        auto it = node.children.find(*first);
+        if (it == node.children.end()) {
+            return false;
+        }
+        bool erased = erase_path(*it->second, std::next(first), last, subscriber);
+        if (it->second->subscribers.empty() && it->second->children.empty()) {
+            node.children.erase(it);
+        }
+        return erased;
+    }
+
+    // Every node on the walk is a pattern that is a prefix (or reversed suffix)
+    // of the symbol, so its subscribers match.
+    template <typename It>
+    static void collect_path(const TrieNode& root, It first, It last, SubscriberSet& out) {
+        const TrieNode* node = &root;
+        while (true) {
+            out.insert(node->subscribers.begin(), node->subscribers.end());
+            if (first == last) {
+                return;
+            }
+            auto it = node->children.find(*first++);
+            if (it == node->children.end()) {
+                return;
+            }
+            node = it->second.get();
+        }
+    }
+
+    std::unordered_map<std::string, SubscriberSet> m_exact;
+    std::unordered_map<std::string, SubscriberSet> m_globs;
+    TrieNode m_prefix_root;
+    TrieNode m_suffix_root;
+    std::unordered_map<std::string, SubscriberList> m_resolved;
+};
+
+template <typename Subscriber, typename Compare>
+constexpr char SubscriptionMatcher<Subscriber, Compare>::WILDCARD;
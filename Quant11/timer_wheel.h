@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+// Single-level hashed timer wheel. Scheduling is O(1); advancing visits only
+// the slots for the ticks that elapsed. Deadlines further out than one wheel
+// revolution stay in their slot until their tick comes around.
+template <typename T>
+class TimerWheel {
+public:
+    using clock = std::chrono::steady_clock;
+
+    TimerWheel(clock::duration tick, size_t slot_count)
+        : m_tick(tick), m_slots(slot_count), m_origin(clock::now()) {}
+
+    // Items due at or before the current tick fire on the next tick.
+    void schedule(T item, clock::time_point deadline) {
+        if (m_size == 0) {
+            // Nothing advanced the wheel while it was idle; catch up so the
+            // next advance does not step through every tick it missed
+            m_current_tick = std::max(m_current_tick, tick_at(clock::now()));
+        }
+        uint64_t tick = tick_at(deadline + m_tick - clock::duration(1));
+        if (tick <= m_current_tick) {
+            tick = m_current_tick + 1;
+        }
+        m_earliest = m_size == 0 ? tick : std::min(m_earliest, tick);
+        m_slots[tick % m_slots.size()].push_back(Entry{tick, std::move(item)});
+        ++m_size;
+    }
+
+    // Fires every item whose deadline is at or before `now`.
+    template <typename F>
+    void advance(clock::time_point now, F&& on_expired) {
+        const uint64_t target = tick_at(now);
+        // Nothing is due before m_earliest, so skip straight to it
+        if (m_size > 0 && m_earliest > m_current_tick + 1) {
+            m_current_tick = std::min(target, m_earliest - 1);
+        }
+        while (m_current_tick < target && m_size > 0) {
+            ++m_current_tick;
+            auto& slot = m_slots[m_current_tick % m_slots.size()];
+            if (slot.empty()) {
+                continue;
+            }
+            std::vector<Entry> due;
+            for (size_t i = 0; i < slot.size();) {
+                if (slot[i].tick <= m_current_tick) {
+                    due.push_back(std::move(slot[i]));
+                    slot[i] = std::move(slot.back());
+                    slot.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+            m_size -= due.size();
+            for (auto& entry : due) {
+                on_expired(entry.item);
+            }
+        }
+        if (m_current_tick < target) {
+            m_current_tick = target;
+        }
+    }
+
+    // When the earliest pending item fires; time_point::max() if none.
+    // Walks forward from the last known earliest tick, so each tick is
+    // examined at most once however often this is called.
+    clock::time_point next_deadline() const {
+        if (m_size == 0) {
+            return clock::time_point::max();
+        }
+        m_earliest = std::max(m_earliest, m_current_tick + 1);
+        while (!due_at(m_earliest)) {
+            ++m_earliest;
+        }
+        return m_origin + m_tick * static_cast<clock::rep>(m_earliest);
+    }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+
+    void clear() {
+        for (auto& slot : m_slots) {
+            slot.clear();
+        }
+        m_size = 0;
+    }
+
+private:
+    struct Entry {
+        uint64_t tick;
+        T item;
+    };
+
+    bool due_at(uint64_t tick) const {
+        for (const auto& entry : m_slots[tick % m_slots.size()]) {
+            if (entry.tick == tick) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint64_t tick_at(clock::time_point when) const {
+        if (when <= m_origin) {
+            return 0;
+        }
+        return static_cast<uint64_t>((when - m_origin) / m_tick);
+    }
+
+    clock::duration m_tick;
+    std::vector<std::vector<Entry>> m_slots;
+    clock::time_point m_origin;
+    uint64_t m_current_tick = 0;
+    // No pending item is due before this tick
+    mutable uint64_t m_earliest = 0;
+    size_t m_size = 0;
+};
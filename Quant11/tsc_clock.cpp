@@ -0,0 +1,73 @@
+#include "tsc_clock.h"
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <ctime>
+
+#if defined(__GNUC__) && defined(TSC_CLOCK_HAS_RDTSC)
+#include <cpuid.h>
+#endif
+
+namespace {
+const std::chrono::milliseconds CALIBRATION_WINDOW(20);
+
+// CPUID.80000007H:EDX[8] advertises a TSC that ticks at a constant rate
+// across P-, C- and T-states
+bool has_invariant_tsc() {
+#if defined(__GNUC__) && defined(TSC_CLOCK_HAS_RDTSC)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007) {
+        return false;
+    }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1u << 8)) != 0;
+#elif defined(TSC_CLOCK_HAS_RDTSC)
+    int regs[4] = {0, 0, 0, 0};
+    __cpuid(regs, 0x80000000);
+    if (static_cast<unsigned int>(regs[0]) < 0x80000007) {
+        return false;
+    }
+    __cpuid(regs, 0x80000007);
+    return (regs[3] & (1 << 8)) != 0;
+#else
+    return false;
+#endif
+}
+}
+
+uint64_t TscClock::os_now_ns() {
+#if defined(CLOCK_MONOTONIC)
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+TscClock::State TscClock::make_state() {
+    State s;
+#if defined(TSC_CLOCK_HAS_RDTSC)
+    if (!has_invariant_tsc()) {
+        return s;
+    }
+
+    // Pair TSC reads with OS clock reads at both ends of a short window
+    const uint64_t start_ns = os_now_ns();
+    const uint64_t start_cycles = __rdtsc();
+    std::this_thread::sleep_for(CALIBRATION_WINDOW);
+    const uint64_t end_ns = os_now_ns();
+    const uint64_t end_cycles = __rdtsc();
+
+    if (end_ns <= start_ns || end_cycles <= start_cycles) {
+        return s;
+    }
+    s.cycles_per_ns = static_cast<double>(end_cycles - start_cycles) / (end_ns - start_ns);
+    s.ns_per_cycle_fp = static_cast<uint64_t>(std::llround(4294967296.0 / s.cycles_per_ns));
+    s.base_cycles = end_cycles;
+    s.base_ns = end_ns;
+    s.use_tsc = true;
+#endif
+    return s;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TSC_CLOCK_HAS_RDTSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define TSC_CLOCK_HAS_RDTSC 1
+#endif
+
+// Nanosecond clock backed by the CPU time-stamp counter.
+//
+// On first use the TSC is checked for the invariant flag and calibrated
+// against the OS monotonic clock; reading it then costs a rdtsc plus a
+// fixed-point multiply. When the TSC is missing or not invariant, now_ns()
+// falls back to clock_gettime(CLOCK_MONOTONIC) and cycles are nanoseconds.
+class TscClock {
+public:
+    // Monotonic nanoseconds on the same timeline as CLOCK_MONOTONIC
+    static uint64_t now_ns() {
+#if defined(TSC_CLOCK_HAS_RDTSC)
+        const State& s = state();
+        if (s.use_tsc) {
+            // Signed: a core whose TSC lags the calibrating core's can read
+            // below base_cycles, and the unsigned delta would wrap
+            const int64_t delta = static_cast<int64_t>(__rdtsc() - s.base_cycles);
+            if (delta < 0) {
+                const uint64_t behind_ns = cycles_to_ns(static_cast<uint64_t>(-delta));
+                return s.base_ns > behind_ns ? s.base_ns - behind_ns : 0;
+            }
+            return s.base_ns + cycles_to_ns(static_cast<uint64_t>(delta));
+        }
+#endif
+        return os_now_ns();
+    }
+
+    // Raw counter: TSC cycles, or nanoseconds when the TSC is not used
+    static uint64_t read_cycles() {
+#if defined(TSC_CLOCK_HAS_RDTSC)
+        if (state().use_tsc) {
+            return __rdtsc();
+        }
+#endif
+        return os_now_ns();
+    }
+
+    // Converts a cycle delta from read_cycles() into nanoseconds
+    static uint64_t cycles_to_ns(uint64_t cycles) {
+        const State& s = state();
+        // cycles * ns_per_cycle with a 32.32 fixed-point multiplier, split so
+        // the product cannot overflow
+        return (cycles >> 32) * s.ns_per_cycle_fp + (((cycles & 0xffffffffULL) * s.ns_per_cycle_fp) >> 32);
+    }
+
+    static bool using_tsc() { return state().use_tsc; }
+    static double cycles_per_ns() { return state().cycles_per_ns; }
+
+    // Calibration happens lazily; call at startup to keep it off the hot path
+    static void calibrate() { state(); }
+
+private:
+    struct State {
+        bool use_tsc = false;
+        double cycles_per_ns = 1.0;
+        uint64_t ns_per_cycle_fp = 1ULL << 32;
+        uint64_t base_cycles = 0;
+        uint64_t base_ns = 0;
+    };
+
+    static const State& state() {
+        static const State s = make_state();
+        return s;
+    }
+
+    static State make_state();
+    static uint64_t os_now_ns();
+};
@@ -67,9 +67,18 @@ WebSocketClient::WebSocketClient() : m_connected(false)
 
 WebSocketClient::~WebSocketClient()
 {
+    if (m_loop_monitor) {
+        m_loop_monitor->stop();
+    }
     disconnect();
 }
 
+void WebSocketClient::set_performance_monitor(PerformanceMonitor& monitor)
+{
+    m_loop_monitor.reset(new EventLoopMonitor(monitor, m_client.get_io_service(), "websocket_client.loop"));
+    m_loop_monitor->start();
+}
+
 context_ptr WebSocketClient::OnTLSInit(const char* hostname, connection_hdl)
 {
     context_ptr ctx = websocketpp::lib::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tlsv12);
@@ -6,6 +6,8 @@
 #include <mutex>
 #include <queue>
 #include <condition_variable>
+#include <memory>
+#include "event_loop_monitor.h"
 
 typedef websocketpp::client<websocketpp::config::asio_tls_client> client;
 typedef websocketpp::config::asio_tls_client::message_type::ptr message_ptr;
@@ -21,6 +23,7 @@ private:
     std::condition_variable m_queue_cv;
     bool m_connected;
     std::mutex m_connected_mutex;
+    std::unique_ptr<EventLoopMonitor> m_loop_monitor;
 
     void on_message(connection_hdl hdl, message_ptr msg);
     void on_open(connection_hdl hdl);
@@ -36,4 +39,6 @@ public:
     void send_message(const std::string& message);
     std::string receive_message();
     bool is_connected() const;
+    // Starts probing the client's io_service for event-loop lag
+    void set_performance_monitor(PerformanceMonitor& monitor);
 };
\ No newline at end of file
@@ -2,9 +2,17 @@
 #include <json/json.h>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+
+namespace {
+// 5ms ticks over 1024 slots: one revolution covers ~5s of throttle intervals
+const std::chrono::milliseconds CONFLATION_TICK(5);
+const size_t CONFLATION_SLOTS = 1024;
+}
 
 WebSocketServer::WebSocketServer(PerformanceMonitor& monitor) 
-    : m_performance_monitor(monitor) {
+    : m_conflation_wheel(CONFLATION_TICK, CONFLATION_SLOTS),
+      m_instrumentation(&monitor) {
     // Set up WebSocket++ server
     m_server.clear_access_channels(websocketpp::log::alevel::all);
     m_server.set_access_channels(websocketpp::log::alevel::connect |
@@ -12,6 +20,8 @@ WebSocketServer::WebSocketServer(PerformanceMonitor& monitor)
                                 websocketpp::log::alevel::app);
 
     m_server.init_asio();
+    m_conflation_timer.reset(new websocketpp::lib::asio::steady_timer(m_server.get_io_service()));
+    m_batch_timer.reset(new websocketpp::lib::asio::steady_timer(m_server.get_io_service()));
 
     // Set up event handlers
     m_server.set_open_handler(bind(&WebSocketServer::on_open, this, std::placeholders::_1));
@@ -29,6 +39,11 @@ void WebSocketServer::start(uint16_t port) {
         m_server.listen(port);
         m_server.start_accept();
         std::cout << "WebSocket server started on port " << port << std::endl;
+        m_instrumentation.set_thread_name("websocket_server");
+        if (PerformanceMonitor* monitor = m_instrumentation.monitor()) {
+            m_loop_monitor.reset(new EventLoopMonitor(*monitor, m_server.get_io_service(), "websocket_server.loop"));
+            m_loop_monitor->start();
+        }
         m_server.run();
     } catch (const std::exception& e) {
         std::cerr << "Error starting WebSocket server: " << e.what() << std::endl;
@@ -37,15 +52,24 @@ void WebSocketServer::start(uint16_t port) {
 
 void WebSocketServer::stop() {
     try {
+        if (m_loop_monitor) {
+            m_loop_monitor->stop();
+        }
         m_server.stop_listening();
         
         {
             std::lock_guard<std::mutex> lock(m_mutex);
-            for (auto& hdl : m_connections) {
-                m_server.close(hdl, websocketpp::close::status::going_away, "Server shutting down");
+            for (auto& connection : m_connections) {
+                m_server.close(connection.first, websocketpp::close::status::going_away, "Server shutting down");
             }
             m_connections.clear();
             m_subscriptions.clear();
+            m_conflation_wheel.clear();
+            m_conflation_timer->cancel();
+            m_conflation_timer_armed = false;
+            m_pending_batches.clear();
+            m_batch_timer->cancel();
+            m_batch_timer_armed = false;
         }
         
         m_server.stop();
@@ -55,49 +79,278 @@ void WebSocketServer::stop() {
 }
 
 void WebSocketServer::broadcast(const std::string& symbol, const std::string& message) {
-    auto start = std::chrono::steady_clock::now();
+    WebSocketServerInstrumentation::Span span(m_instrumentation, BuiltinMetric::WebSocketBroadcast);
     std::lock_guard<std::mutex> lock(m_mutex);
     
-    auto it = m_subscriptions.find(symbol);
-    if (it != m_subscriptions.end()) {
-        for (const auto& hdl : it->second) {
-            try {
-                m_server.send(hdl, message, websocketpp::frame::opcode::text);
-            } catch (const std::exception& e) {
-                std::cerr << "Error broadcasting message: " << e.what() << std::endl;
+    const auto now = std::chrono::steady_clock::now();
+    for (ConnectionState* connection : m_subscriptions.resolve(symbol)) {
+        if (connection->throttled_subscriptions == 0) {
+            send_to(*connection, message);
+        } else {
+            deliver_throttled(*connection, symbol, message, now);
+        }
+    }
+    // Queue depth: connections left holding an unsent batch
+    span.set_context(SampleContext(symbol, static_cast<uint32_t>(m_pending_batches.size()),
+                                   static_cast<uint32_t>(message.size())));
+}
+
+bool WebSocketServer::enable_batching(std::chrono::microseconds window, size_t max_bytes) {
+    if (window.count() > 0 && max_bytes == 0) {
+        std::cerr << "Batching needs a non-zero frame size limit" << std::endl;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_batch_window = window;
+    m_batch_max_bytes = max_bytes;
+    return true;
+}
+
+void WebSocketServer::send_to(ConnectionState& connection, const std::string& message) {
+    if (m_batch_window.count() == 0) {
+        send_frame(connection.hdl, message);
+        return;
+    }
+
+    // Brackets and separator included, so a frame only exceeds the limit
+    // when a single message does
+    if (!connection.batch.empty() && connection.batch.size() + message.size() + 2 > m_batch_max_bytes) {
+        flush_batch(connection);
+    }
+    if (connection.batch.empty()) {
+        connection.batch.reserve(m_batch_max_bytes);
+        connection.batch += '[';
+    } else {
+        connection.batch += ',';
+    }
+    connection.batch += message;
+
+    if (connection.batch.size() >= m_batch_max_bytes) {
+        flush_batch(connection);
+        return;
+    }
+    if (!connection.batch_queued) {
+        connection.batch_queued = true;
+        m_pending_batches.push_back(connection.shared_from_this());
+    }
+    if (!m_batch_timer_armed) {
+        m_batch_timer_armed = true;
+        m_batch_timer->expires_from_now(m_batch_window);
+        m_batch_timer->async_wait(bind(&WebSocketServer::on_batch_timer, this, std::placeholders::_1));
+    }
+}
+
+void WebSocketServer::send_frame(connection_hdl hdl, const std::string& payload) {
+    try {
+        m_server.send(hdl, payload, websocketpp::frame::opcode::text);
+    } catch (const std::exception& e) {
+        std::cerr << "Error broadcasting message: " << e.what() << std::endl;
+    }
+}
+
+void WebSocketServer::flush_batch(ConnectionState& connection) {
+    if (connection.batch.empty()) {
+        return;
+    }
+    connection.batch += ']';
+    send_frame(connection.hdl, connection.batch);
+    connection.batch.clear();
+}
+
+void WebSocketServer::on_batch_timer(const websocketpp::lib::asio::error_code& ec) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_batch_timer_armed = false;
+    if (ec) {
+        return;
+    }
+    for (const auto& pending : m_pending_batches) {
+        if (auto connection = pending.lock()) {
+            connection->batch_queued = false;
+            flush_batch(*connection);
+        }
+    }
+    m_pending_batches.clear();
+}
+
+void WebSocketServer::deliver_throttled(ConnectionState& connection, const std::string& symbol,
+                                        const std::string& message, std::chrono::steady_clock::time_point now) {
+    auto it = connection.deliveries.find(symbol);
+    if (it == connection.deliveries.end()) {
+        it = connection.deliveries.emplace(symbol, make_delivery(connection, symbol)).first;
+    }
+    DeliveryState& delivery = it->second;
+
+    if (delivery.interval_ms == 0 && !delivery.scheduled) {
+        send_to(connection, message);
+        return;
+    }
+
+    auto next_allowed = delivery.last_sent + std::chrono::milliseconds(delivery.interval_ms);
+    if (!delivery.scheduled && now >= next_allowed) {
+        send_to(connection, message);
+        delivery.last_sent = now;
+        return;
+    }
+
+    // Conflate: keep only the latest update until the interval elapses
+    delivery.pending = message;
+    if (!delivery.scheduled) {
+        delivery.scheduled = true;
+        delivery.due = next_allowed;
+        m_conflation_wheel.schedule(conflation_key(connection.shared_from_this(), symbol), next_allowed);
+        arm_conflation_timer();
+    }
+}
+
+// The effective interval is the smallest among the connection's subscriptions
+// that match the symbol, so an exact every-tick subscription wins over a
+// throttled wildcard.
+WebSocketServer::DeliveryState WebSocketServer::make_delivery(const ConnectionState& connection,
+                                                              const std::string& symbol) const {
+    DeliveryState delivery;
+    for (const auto& subscription : connection.subscriptions) {
+        if (subscription.first == symbol || subscription_index::matches(subscription.first, symbol)) {
+            delivery.interval_ms = delivery.subscribed
+                ? std::min(delivery.interval_ms, subscription.second)
+                : subscription.second;
+            delivery.subscribed = true;
+        }
+    }
+    return delivery;
+}
+
+void WebSocketServer::refresh_deliveries(ConnectionState& connection) {
+    for (auto it = connection.deliveries.begin(); it != connection.deliveries.end();) {
+        DeliveryState updated = make_delivery(connection, it->first);
+        DeliveryState& delivery = it->second;
+        if (!updated.subscribed || updated.interval_ms == 0 || connection.throttled_subscriptions == 0) {
+            // Updates for the symbol now go out directly, so send the held
+            // one first or it would arrive after newer ones. The wheel entry
+            // is skipped when it fires.
+            if (delivery.scheduled && updated.subscribed) {
+                send_to(connection, delivery.pending);
             }
+            it = connection.deliveries.erase(it);
+            continue;
         }
+        delivery.interval_ms = updated.interval_ms;
+        delivery.subscribed = updated.subscribed;
+        ++it;
     }
-    
-    auto end = std::chrono::steady_clock::now();
-    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-    m_performance_monitor.record_latency("websocket_broadcast", latency);
 }
 
-void WebSocketServer::handle_subscription(connection_hdl hdl, const std::string& symbol) {
-    auto start = std::chrono::steady_clock::now();
-    
+// Sleeps until the earliest pending update is due rather than ticking
+void WebSocketServer::arm_conflation_timer() {
+    if (m_conflation_wheel.empty()) {
+        return;
+    }
+    const auto deadline = m_conflation_wheel.next_deadline();
+    if (m_conflation_timer_armed && m_conflation_timer_expiry <= deadline) {
+        return;
+    }
+    // Re-arming cancels the later wait, whose handler then sees operation_aborted
+    m_conflation_timer_armed = true;
+    m_conflation_timer_expiry = deadline;
+    m_conflation_timer->expires_at(deadline);
+    m_conflation_timer->async_wait(bind(&WebSocketServer::on_conflation_timer, this, std::placeholders::_1));
+}
+
+void WebSocketServer::on_conflation_timer(const websocketpp::lib::asio::error_code& ec) {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_subscriptions[symbol].insert(hdl);
-    std::cout << "New subscription for symbol: " << symbol << std::endl;
+    if (ec) {
+        // Cancelled by a re-arm or by stop(), which track the armed state themselves
+        return;
+    }
+    m_conflation_timer_armed = false;
+
+    auto now = std::chrono::steady_clock::now();
+    m_conflation_wheel.advance(now, [this, now](const conflation_key& key) {
+        auto connection = key.first.lock();
+        if (!connection) {
+            return;
+        }
+        auto it = connection->deliveries.find(key.second);
+        if (it == connection->deliveries.end() || !it->second.scheduled || now < it->second.due) {
+            return;
+        }
+        DeliveryState& delivery = it->second;
+        delivery.scheduled = false;
+        if (delivery.subscribed) {
+            send_to(*connection, delivery.pending);
+            delivery.last_sent = now;
+        }
+        delivery.pending.clear();
+    });
+    arm_conflation_timer();
+}
+
+void WebSocketServer::handle_subscription(connection_hdl hdl, const std::string& symbol, uint32_t interval_ms) {
+    WebSocketServerInstrumentation::Span span(m_instrumentation, BuiltinMetric::SubscriptionHandling);
     
-    auto end = std::chrono::steady_clock::now();
-    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-    m_performance_monitor.record_latency("subscription_handling", latency);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_connections.find(hdl);
+    if (it == m_connections.end()) {
+        return;
+    }
+    ConnectionState& connection = *it->second;
+    auto existing = connection.subscriptions.find(symbol);
+    if (existing != connection.subscriptions.end()) {
+        connection.throttled_subscriptions -= existing->second > 0 ? 1 : 0;
+        existing->second = interval_ms;
+    } else {
+        connection.subscriptions.emplace(symbol, interval_ms);
+        m_subscriptions.add(symbol, &connection);
+    }
+    connection.throttled_subscriptions += interval_ms > 0 ? 1 : 0;
+    refresh_deliveries(connection);
+    std::cout << "New subscription for "
+              << (subscription_index::is_pattern(symbol) ? "pattern: " : "symbol: ")
+              << symbol;
+    if (interval_ms > 0) {
+        std::cout << " every " << interval_ms << "ms";
+    }
+    std::cout << std::endl;
+}
+
+void WebSocketServer::handle_unsubscription(connection_hdl hdl, const std::string& symbol) {
+    WebSocketServerInstrumentation::Span span(m_instrumentation, BuiltinMetric::SubscriptionHandling);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_connections.find(hdl);
+    if (it == m_connections.end()) {
+        return;
+    }
+    ConnectionState& connection = *it->second;
+    auto existing = connection.subscriptions.find(symbol);
+    if (existing == connection.subscriptions.end()) {
+        return;
+    }
+    connection.throttled_subscriptions -= existing->second > 0 ? 1 : 0;
+    connection.subscriptions.erase(existing);
+    m_subscriptions.remove(symbol, &connection);
+    refresh_deliveries(connection);
 }
 
 void WebSocketServer::remove_connection(connection_hdl hdl) {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_connections.erase(hdl);
-    for (auto& pair : m_subscriptions) {
-        pair.second.erase(hdl);
+    auto it = m_connections.find(hdl);
+    if (it == m_connections.end()) {
+        return;
     }
+    ConnectionState& connection = *it->second;
+    for (const auto& subscription : connection.subscriptions) {
+        m_subscriptions.remove(subscription.first, &connection);
+    }
+    // Pending conflated updates are dropped once the wheel sees the expired state
+    m_connections.erase(it);
     m_connection_count--;
 }
 
 void WebSocketServer::on_open(connection_hdl hdl) {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_connections.insert(hdl);
+    auto connection = std::make_shared<ConnectionState>();
+    connection->hdl = hdl;
+    m_connections.emplace(hdl, connection);
     m_connection_count++;
     std::cout << "New WebSocket connection established. Total connections: " 
               << m_connection_count << std::endl;
@@ -110,47 +363,25 @@ void WebSocketServer::on_close(connection_hdl hdl) {
 }
 
 void WebSocketServer::on_message(connection_hdl hdl, message_ptr msg) {
-    auto start = std::chrono::steady_clock::now();
+    WebSocketServerInstrumentation::Span span(m_instrumentation, BuiltinMetric::WebSocketMessageProcessing);
     
     try {
         Json::Value json_msg;
         Json::Reader reader;
         if (reader.parse(msg->get_payload(), json_msg)) {
-            if (json_msg.isMember("type") && json_msg["type"].asString() == "subscribe") {
-                if (json_msg.isMember("symbol")) {
-                    handle_subscription(hdl, json_msg["symbol"].asString());
+            const std::string type = json_msg.get("type", "").asString();
+            if (json_msg.isMember("symbol")) {
+                span.set_context(SampleContext(json_msg["symbol"].asString(), 0,
+                                               static_cast<uint32_t>(msg->get_payload().size())));
+                if (type == "subscribe") {
+                    handle_subscription(hdl, json_msg["symbol"].asString(),
+                                        json_msg.get("interval_ms", 0).asUInt());
+                } else if (type == "unsubscribe") {
+                    handle_unsubscription(hdl, json_msg["symbol"].asString());
                 }
             }
         }
     } catch (const std::exception& e) {
         std::cerr << "Error processing message: " << e.what() << std::endl;
     }
-
-    auto end = std::chrono::steady_clock::now();
-    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-    m_performance_monitor.record_latency("websocket_message_processing", latency);
 }
-
-double WebSocketServer::get_average_latency() const {
-    if (m_metrics.total_messages == 0) return 0.0;
-    return static_cast<double>(m_metrics.total_latency) / m_metrics.total_messages;
-}
-
-double WebSocketServer::get_message_rate() const {
-    auto now = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - m_start_time).count();
-    if (duration == 0) return 0.0;
-    return static_cast<double>(m_metrics.total_messages) / duration;
-}
-
-uint64_t WebSocketServer::get_total_connections() const {
-    return m_connection_count;
-}
-
-uint64_t WebSocketServer::get_total_messages() const {
-    return m_metrics.total_messages;
-}
-
-uint64_t WebSocketServer::get_max_latency() const {
-    return m_metrics.max_latency;
-} 
\ No newline at end of file
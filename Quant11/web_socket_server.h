@@ -2,12 +2,19 @@
 
 #include <websocketpp/server.hpp>
 #include <websocketpp/config/asio_no_tls.hpp>
-#include "performance_monitor.h"
+#include "instrumentation.h"
+#include "event_loop_monitor.h"
+#include "subscription_matcher.h"
+#include "timer_wheel.h"
 #include <unordered_map>
+#include <map>
+#include <vector>
 #include <set>
 #include <mutex>
 #include <atomic>
+#include <memory>
 #include <string>
+#include <chrono>
 
 using websocketpp_server = websocketpp::server<websocketpp::config::asio>;
 using connection_hdl = websocketpp::connection_hdl;
@@ -15,18 +22,71 @@ using message_ptr = websocketpp_server::message_ptr;
 
 class WebSocketServer {
 private:
+    // Conflation state for one concrete symbol on a throttled connection
+    struct DeliveryState {
+        uint32_t interval_ms = 0;
+        bool subscribed = false;
+        bool scheduled = false;
+        // When the scheduled send is due; older wheel entries for a delivery
+        // that was flushed and re-created fire before it and are ignored
+        std::chrono::steady_clock::time_point due;
+        std::chrono::steady_clock::time_point last_sent;
+        std::string pending;
+    };
+
+    // Reverse index of what a connection is subscribed to, so disconnect and
+    // unsubscribe only touch that connection's entries
+    struct ConnectionState : std::enable_shared_from_this<ConnectionState> {
+        connection_hdl hdl;
+        // Symbol or pattern -> minimum interval between updates (0 = every update)
+        std::unordered_map<std::string, uint32_t> subscriptions;
+        size_t throttled_subscriptions = 0;
+        std::unordered_map<std::string, DeliveryState> deliveries;
+        // Updates coalesced into the next frame when batching is enabled
+        std::string batch;
+        bool batch_queued = false;
+    };
+
+    using subscription_index = SubscriptionMatcher<ConnectionState*>;
+    using conflation_key = std::pair<std::weak_ptr<ConnectionState>, std::string>;
+
     websocketpp_server m_server;
-    std::unordered_map<std::string, std::set<connection_hdl, std::owner_less<connection_hdl>>> m_subscriptions;
-    std::set<connection_hdl, std::owner_less<connection_hdl>> m_connections;
+    // Exact symbols and wildcard patterns such as "BTC-*" or "*-PERPETUAL"
+    subscription_index m_subscriptions;
+    std::map<connection_hdl, std::shared_ptr<ConnectionState>, std::owner_less<connection_hdl>> m_connections;
+    // Throttled deliveries waiting for their interval to elapse
+    TimerWheel<conflation_key> m_conflation_wheel;
+    std::unique_ptr<websocketpp::lib::asio::steady_timer> m_conflation_timer;
+    bool m_conflation_timer_armed = false;
+    std::chrono::steady_clock::time_point m_conflation_timer_expiry;
+    // Frame batching; a zero window disables it
+    std::chrono::microseconds m_batch_window{0};
+    size_t m_batch_max_bytes = 0;
+    std::vector<std::weak_ptr<ConnectionState>> m_pending_batches;
+    std::unique_ptr<websocketpp::lib::asio::steady_timer> m_batch_timer;
+    bool m_batch_timer_armed = false;
     std::mutex m_mutex;
     std::atomic<uint64_t> m_connection_count{0};
-    PerformanceMonitor& m_performance_monitor;
+    WebSocketServerInstrumentation m_instrumentation;
+    // Probes the server's io_service while instrumented
+    std::unique_ptr<EventLoopMonitor> m_loop_monitor;
 
     // WebSocket event handlers
     void on_open(connection_hdl hdl);
     void on_close(connection_hdl hdl);
     void on_message(connection_hdl hdl, message_ptr msg);
 
+    void send_to(ConnectionState& connection, const std::string& message);
+    void send_frame(connection_hdl hdl, const std::string& payload);
+    void flush_batch(ConnectionState& connection);
+    void on_batch_timer(const websocketpp::lib::asio::error_code& ec);
+    void deliver_throttled(ConnectionState& connection, const std::string& symbol,
+                           const std::string& message, std::chrono::steady_clock::time_point now);
+    DeliveryState make_delivery(const ConnectionState& connection, const std::string& symbol) const;
+    void refresh_deliveries(ConnectionState& connection);
+    void arm_conflation_timer();
+    void on_conflation_timer(const websocketpp::lib::asio::error_code& ec);
+
 public:
     explicit WebSocketServer(PerformanceMonitor& monitor);
     ~WebSocketServer();
@@ -37,10 +97,20 @@ public:
     WebSocketServer(WebSocketServer&&) = delete;
     WebSocketServer& operator=(WebSocketServer&&) = delete;
 
+    // Coalesces every update queued for a connection within `window`, or until
+    // the frame would exceed `max_bytes`, into one frame holding a JSON array of
+    // the individual messages; only a single oversized message exceeds it. Call
+    // before start(); a zero window disables batching. False if max_bytes is 0.
+    bool enable_batching(std::chrono::microseconds window, size_t max_bytes);
+
     void start(uint16_t port);
     void stop();
     void broadcast(const std::string& symbol, const std::string& message);
-    void handle_subscription(connection_hdl hdl, const std::string& symbol);
+    // Accepts an exact symbol or a wildcard pattern. A non-zero interval
+    // conflates updates so the subscriber receives at most the latest state
+    // once per interval for each matching symbol.
+    void handle_subscription(connection_hdl hdl, const std::string& symbol, uint32_t interval_ms = 0);
+    void handle_unsubscription(connection_hdl hdl, const std::string& symbol);
     void remove_connection(connection_hdl hdl);
     
     uint64_t get_total_connections() const { return m_connection_count; }
@@ -0,0 +1,291 @@
+// Synthetic fan-out benchmark for WebSocketServer.
+//
+// Starts the server on loopback, attaches N clients that each subscribe to M
+// symbols, publishes at a fixed rate and reports delivered throughput,
+// end-to-end latency percentiles, memory per connection and CPU use.
+//
+// Usage: ws_load_generator [--clients N] [--subs M] [--symbols S] [--rate R]
+//                          [--duration SEC] [--port P] [--batch-us W]
+//                          [--metrics-port P] [--metrics-log F] [--trace-file F]
+//                          [--jitter 1]
+
+#include "web_socket_server.h"
+#include "performance_monitor.h"
+#include "metrics_http_server.h"
+#include "metrics_exporter.h"
+#include <websocketpp/client.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using load_client = websocketpp::client<websocketpp::config::asio_client>;
+
+namespace {
+
+// Longest wait for every client to connect before the run is abandoned
+const std::chrono::seconds CONNECT_TIMEOUT(10);
+
+struct LoadConfig {
+    size_t clients = 100;
+    size_t subscriptions_per_client = 10;
+    size_t symbols = 100;
+    double publish_rate = 10000.0;
+    int duration_sec = 10;
+    uint16_t port = 9002;
+    long batch_window_us = 0;
+    // Serves the server monitor at /metrics while the run lasts; 0 disables
+    uint16_t metrics_port = 0;
+    // JSON lines file receiving a server metrics snapshot every second
+    std::string metrics_log;
+    // Chrome trace-event dump of the server's spans, written at the end
+    std::string trace_file;
+    // Spinning scheduler-jitter probe; occupies one core while running
+    bool jitter = false;
+};
+
+bool ParseArgs(int argc, char* argv[], LoadConfig& config)
+{
+    for (int i = 1; i < argc; i += 2) {
+        const std::string flag = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Missing value for " << flag << "\n";
+            return false;
+        }
+        const char* value = argv[i + 1];
+        if (flag == "--clients") config.clients = std::strtoul(value, nullptr, 10);
+        else if (flag == "--subs") config.subscriptions_per_client = std::strtoul(value, nullptr, 10);
+        else if (flag == "--symbols") config.symbols = std::strtoul(value, nullptr, 10);
+        else if (flag == "--rate") config.publish_rate = std::strtod(value, nullptr);
+        else if (flag == "--duration") config.duration_sec = std::atoi(value);
+        else if (flag == "--port") config.port = static_cast<uint16_t>(std::atoi(value));
+        else if (flag == "--batch-us") config.batch_window_us = std::atol(value);
+        else if (flag == "--metrics-port") config.metrics_port = static_cast<uint16_t>(std::atoi(value));
+        else if (flag == "--metrics-log") config.metrics_log = value;
+        else if (flag == "--trace-file") config.trace_file = value;
+        else if (flag == "--jitter") config.jitter = std::atoi(value) != 0;
+        else {
+            std::cerr << "Unknown option: " << flag << "\n";
+            return false;
+        }
+    }
+    return config.clients > 0 && config.symbols > 0 && config.publish_rate > 0;
+}
+
+std::string SymbolName(size_t index)
+{
+    return "LOAD-" + std::to_string(index);
+}
+
+// Resident set size in bytes, from /proc/self/statm
+uint64_t ResidentBytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    uint64_t pages_total = 0, pages_resident = 0;
+    statm >> pages_total >> pages_resident;
+    return pages_resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+double CpuSeconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// CPU time consumed so far by one thread of this process
+double ThreadCpuSeconds(std::thread& thread)
+{
+    clockid_t clock_id;
+    timespec ts{};
+    if (pthread_getcpuclockid(thread.native_handle(), &clock_id) != 0 || clock_gettime(clock_id, &ts) != 0) {
+        return 0.0;
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    LoadConfig config;
+    if (!ParseArgs(argc, argv, config)) {
+        std::cerr << "Usage: ws_load_generator [--clients N] [--subs M] [--symbols S] [--rate R]"
+                  << " [--duration SEC] [--port P] [--batch-us W] [--metrics-port P]"
+                  << " [--metrics-log F] [--trace-file F] [--jitter 1]\n";
+        return 1;
+    }
+
+    PerformanceMonitor server_monitor;
+    PerformanceMonitor load_monitor;
+    if (!config.trace_file.empty()) {
+        server_monitor.enable_tracing();
+    }
+    WebSocketServer server(server_monitor);
+    if (config.batch_window_us > 0 &&
+        !server.enable_batching(std::chrono::microseconds(config.batch_window_us), 64 * 1024)) {
+        std::cerr << "Invalid batch window: " << config.batch_window_us << "us\n";
+        return 1;
+    }
+    JitterMonitor jitter_monitor(server_monitor);
+    if (config.jitter) {
+        jitter_monitor.start();
+    }
+    std::thread server_thread([&server, &config] { server.start(config.port); });
+    MetricsHttpServer metrics_server(server_monitor, config.metrics_port);
+    if (config.metrics_port != 0) {
+        metrics_server.start();
+    }
+    MetricsExporter metrics_exporter(server_monitor, config.metrics_log);
+    if (!config.metrics_log.empty()) {
+        metrics_exporter.start();
+    }
+
+    const uint64_t rss_before = ResidentBytes();
+
+    const MetricHandle end_to_end = load_monitor.register_metric("end_to_end");
+    std::atomic<uint64_t> delivered{0};
+    load_client client;
+    client.clear_access_channels(websocketpp::log::alevel::all);
+    client.clear_error_channels(websocketpp::log::elevel::all);
+    client.init_asio();
+    EventLoopMonitor client_loop(load_monitor, client.get_io_service(), "load_client.loop");
+    client_loop.start();
+
+    // Every timestamped update in the frame counts, so batched frames are
+    // measured per message rather than per frame.
+    client.set_message_handler([&](connection_hdl, load_client::message_ptr msg) {
+        const uint64_t now = PerformanceMonitor::now_ns();
+        const std::string& payload = msg->get_payload();
+        static const char key[] = "\"ts\":";
+        for (size_t pos = payload.find(key); pos != std::string::npos; pos = payload.find(key, pos)) {
+            pos += sizeof(key) - 1;
+            const uint64_t sent = std::strtoull(payload.c_str() + pos, nullptr, 10);
+            load_monitor.record_latency_ns(end_to_end, now - sent);
+            delivered++;
+        }
+    });
+
+    std::atomic<size_t> next_client{0};
+    client.set_open_handler([&](connection_hdl hdl) {
+        const size_t index = next_client++;
+        for (size_t j = 0; j < config.subscriptions_per_client; ++j) {
+            const std::string symbol = SymbolName((index * config.subscriptions_per_client + j) % config.symbols);
+            client.send(hdl, "{\"type\":\"subscribe\",\"symbol\":\"" + symbol + "\"}",
+                        websocketpp::frame::opcode::text);
+        }
+    });
+
+    std::thread client_thread;
+    // Every early exit must stop both endpoints and join their threads
+    auto shutdown = [&] {
+        jitter_monitor.stop();
+        client_loop.stop();
+        metrics_exporter.stop();
+        client.stop();
+        server.stop();
+        if (client_thread.joinable()) {
+            client_thread.join();
+        }
+        server_thread.join();
+    };
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    const std::string uri = "ws://127.0.0.1:" + std::to_string(config.port);
+    for (size_t i = 0; i < config.clients; ++i) {
+        websocketpp::lib::error_code ec;
+        auto con = client.get_connection(uri, ec);
+        if (ec) {
+            std::cerr << "Connection initialization error: " << ec.message() << "\n";
+            shutdown();
+            return 1;
+        }
+        client.connect(con);
+    }
+    client_thread = std::thread([&client] { client.run(); });
+
+    // Bounded, so a server that failed to bind or a client that failed to
+    // connect ends the run instead of hanging it
+    const auto connect_deadline = std::chrono::steady_clock::now() + CONNECT_TIMEOUT;
+    while (server.get_total_connections() < config.clients && std::chrono::steady_clock::now() < connect_deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (server.get_total_connections() < config.clients) {
+        std::cerr << "Only " << server.get_total_connections() << " of " << config.clients
+                  << " clients connected within " << CONNECT_TIMEOUT.count() << "s\n";
+        shutdown();
+        return 1;
+    }
+    // Give the subscribe messages time to be processed
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    const uint64_t rss_after = ResidentBytes();
+
+    // Each symbol is subscribed by this many connections on average
+    const double fanout = static_cast<double>(config.clients * config.subscriptions_per_client) / config.symbols;
+
+    std::cout << "Publishing " << config.publish_rate << " msgs/sec to " << config.clients
+              << " clients (" << config.subscriptions_per_client << " subscriptions each, "
+              << config.symbols << " symbols, ~" << std::fixed << std::setprecision(1) << fanout
+              << " subscribers per symbol) for " << config.duration_sec << "s\n";
+
+    const double cpu_start = CpuSeconds();
+    const double server_cpu_start = ThreadCpuSeconds(server_thread);
+    const auto wall_start = std::chrono::steady_clock::now();
+    const auto interval = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / config.publish_rate));
+    const auto deadline = wall_start + std::chrono::seconds(config.duration_sec);
+    auto next_publish = wall_start;
+    uint64_t published = 0;
+
+    while (next_publish < deadline) {
+        const std::string symbol = SymbolName(published % config.symbols);
+        server.broadcast(symbol, "{\"symbol\":\"" + symbol + "\",\"seq\":" + std::to_string(published) +
+                                 ",\"ts\":" + std::to_string(PerformanceMonitor::now_ns()) + "}");
+        ++published;
+        next_publish += interval;
+        // Sleeps rather than spins so the process CPU figure is not dominated by the publisher
+        std::this_thread::sleep_until(next_publish);
+    }
+
+    // Let in-flight messages drain before taking the totals
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    const double wall_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    const double cpu_sec = CpuSeconds() - cpu_start;
+    const double server_cpu_sec = ThreadCpuSeconds(server_thread) - server_cpu_start;
+
+    std::cout << "\nLoad Results:\n";
+    std::cout << "=============\n";
+    std::cout << "  Published: " << published << " (" << std::setprecision(0)
+              << published / wall_sec << " msgs/sec)\n";
+    std::cout << "  Delivered: " << delivered << " (" << delivered / wall_sec << " msgs/sec, expected ~"
+              << published * fanout << ")\n";
+    std::cout << "  Memory/connection: " << std::setprecision(1)
+              << (rss_after > rss_before ? (rss_after - rss_before) / 1024.0 / config.clients : 0.0)
+              << " KiB (client and server side)\n";
+    std::cout << "  Server CPU: " << std::setprecision(1) << 100.0 * server_cpu_sec / wall_sec
+              << "% of one core (server thread only)\n";
+    std::cout << "  Process CPU: " << 100.0 * cpu_sec / wall_sec
+              << "% of one core (server, clients and publisher)\n";
+    jitter_monitor.stop();
+    client_loop.stop();
+    metrics_exporter.stop();
+    load_monitor.print_metrics();
+    server_monitor.print_metrics();
+    if (!config.trace_file.empty() && !server_monitor.dump_trace(config.trace_file)) {
+        std::cerr << "Failed to write trace to " << config.trace_file << "\n";
+    }
+
+    shutdown();
+    return 0;
+}